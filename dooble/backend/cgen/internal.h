@@ -9,13 +9,61 @@ typedef struct {
 	bool is_union;
 } AnonStruct;
 
+typedef struct {
+	u64 size;
+	u32 align;  // 0 when the type has no layout: a map, an unknown name, a struct that holds itself
+	u32 fields; // of a struct or union, where its members start in offsets and order
+
+	enum : u8 {
+		LAYOUT_NONE,
+		LAYOUT_BUSY, // its members are being laid out
+		LAYOUT_DONE,
+	} state;
+} TypeLayout;
+
+typedef struct {
+	typeid type;
+	u16    member;
+} HotField;
+
+typedef VEC(TypeLayout) LayoutCache; // by typeid
+
+#define LAYOUT_SCALARS 6 // builtin names with a C type of their own
+
+/* Sizes, alignments and member offsets of types as the C backend emits them,
+ * worked out once per typeid. With reorder on, struct members are emitted hot
+ * ones first and then by descending alignment, which leaves the least padding.
+ *
+ * A typeid is the whole type, so the layout of *struct {...} is a pointer's.
+ * The struct at its base is laid out in records, under the same typeid. */
+typedef struct {
+	TypeTree *types;
+	bool      reorder;
+	Symbol    scalars[LAYOUT_SCALARS]; // their names, interned once
+
+	LayoutCache   layouts;
+	LayoutCache   records; // of the struct or union a type ends in
+	VEC(u64)      offsets; // of each member, in declaration order
+	VEC(u16)      order;   // member emitted at each position
+	VEC(HotField) hot;
+} Layouts;
+
 typedef struct {
 	CodeGen codegen;
 
 	// type information
+	TypeTree       *types;
+	Layouts         layouts;
 	VEC(AnonStruct) anon_structs;
 	HashMap         type_map;
 } GenCompiler;
 
 void  init_compiler(GenCompiler *compiler);
 CType build_type(GenCompiler *comp, typeid id);
+
+Layouts           init_layouts(TypeTree *types, bool reorder);
+void              free_layouts(Layouts *layouts);
+void              mark_hot(Layouts *layouts, typeid ztruct, u16 member); // before the struct is laid out
+const TypeLayout *type_layout(Layouts *layouts, typeid type);
+u64               member_offset(Layouts *layouts, typeid ztruct, u16 member);
+u16               member_at(Layouts *layouts, typeid ztruct, u16 position);
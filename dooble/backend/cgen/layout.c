@@ -0,0 +1,290 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LAYOUT_INIT_TYPES 64
+#define LAYOUT_INIT_ITEMS 64
+#define LAYOUT_INIT_HOT   4
+#define TYPE_DEPTH_MAX    64 // modifiers on one type, a deeper one has no layout
+#define PTR_SIZE          8
+
+// the C types the builtin names of init_TypeTree are emitted as, aligned to
+// their size
+static const struct {
+	const char *name;
+	u32         size;
+} SCALARS[LAYOUT_SCALARS] = {
+	{ "int",  4 }, { "float",  4 }, { "dooble", 8 }, { "bool", 1 },
+	{ "char", 1 }, { "string", PTR_SIZE },
+};
+
+static const TypeLayout NO_LAYOUT = { .state = LAYOUT_DONE };
+
+static TypeLayout fixed(u64 size, u32 align) {
+	return (TypeLayout) { .size = size, .align = align, .state = LAYOUT_DONE };
+}
+
+static u64 align_up(u64 offset, u32 align) {
+	return (offset + align - 1) & ~(u64) (align - 1);
+}
+
+// makes room for `need` items in a VEC, the new ones are zeroed
+#define RESERVE(vec, need, init) \
+	reserve((void **) &(vec).arr, &(vec).cap, sizeof(*(vec).arr), need, init)
+
+static void reserve(void **arr, size_t *cap, size_t size, size_t need, size_t init) {
+	if (need <= *cap) return;
+
+	size_t grown = *cap ? *cap : init;
+	while (grown < need) grown *= 2;
+
+	char *tmp = realloc(*arr, size * grown);
+	if (tmp == NULL) PANIC("could not extend type layouts");
+
+	memset(&tmp[size * *cap], 0, size * (grown - *cap));
+	*arr = tmp;
+	*cap = grown;
+}
+
+Layouts init_layouts(TypeTree *types, bool reorder) {
+	Layouts layouts = {
+		.types   = types,
+		.reorder = reorder,
+
+		.layouts = { .arr = make(TypeLayout, LAYOUT_INIT_TYPES), .cap = LAYOUT_INIT_TYPES },
+		.records = { .arr = make(TypeLayout, LAYOUT_INIT_TYPES), .cap = LAYOUT_INIT_TYPES },
+		.offsets = { .arr = make(u64, LAYOUT_INIT_ITEMS), .cap = LAYOUT_INIT_ITEMS },
+		.order   = { .arr = make(u16, LAYOUT_INIT_ITEMS), .cap = LAYOUT_INIT_ITEMS },
+		.hot     = { .arr = make(HotField, LAYOUT_INIT_HOT), .cap = LAYOUT_INIT_HOT },
+	};
+
+	for_range (i, LAYOUT_SCALARS) layouts.scalars[i] = intern_cstr(SCALARS[i].name);
+	return layouts;
+}
+
+void free_layouts(Layouts *layouts) {
+	free(layouts->layouts.arr);
+	free(layouts->records.arr);
+	free(layouts->offsets.arr);
+	free(layouts->order.arr);
+	free(layouts->hot.arr);
+	*layouts = (Layouts) {};
+}
+
+void mark_hot(Layouts *layouts, typeid ztruct, u16 member) {
+	RESERVE(layouts->hot, layouts->hot.len + 1, LAYOUT_INIT_HOT);
+	layouts->hot.arr[layouts->hot.len++] = (HotField) {
+		.type   = canonical_type(layouts->types, ztruct),
+		.member = member,
+	};
+}
+
+static bool is_hot(const Layouts *layouts, typeid ztruct, u16 member) {
+	for_range (i, layouts->hot.len) {
+		const HotField *hot = &layouts->hot.arr[i];
+		if (hot->type == ztruct && hot->member == member) return true;
+	}
+
+	return false;
+}
+
+// hot members first, then by descending alignment. Equal ones keep their order
+static bool goes_before(const Layouts *layouts, typeid ztruct, const TypeLayout *members, u16 a, u16 b) {
+	const bool hot_a = is_hot(layouts, ztruct, a);
+	const bool hot_b = is_hot(layouts, ztruct, b);
+	if (hot_a != hot_b) return hot_a;
+
+	return members[a].align > members[b].align;
+}
+
+// the cached layout of a type, every one past the end starts as LAYOUT_NONE
+static TypeLayout *cached(LayoutCache *cache, typeid type) {
+	RESERVE(*cache, (size_t) type + 1, LAYOUT_INIT_TYPES);
+	return &cache->arr[type];
+}
+
+static TypeLayout layout_record(Layouts *layouts, typeid id, const TypeLeaf *leaf) {
+	const u16  count  = leaf->members.len;
+	const bool merged = leaf->tag == DBLTP_UNION;
+
+	// taken before the members are laid out, theirs go after it
+	const u32 fields = layouts->offsets.len;
+	RESERVE(layouts->offsets, fields + count, LAYOUT_INIT_ITEMS);
+	RESERVE(layouts->order,   fields + count, LAYOUT_INIT_ITEMS);
+
+	layouts->offsets.len += count;
+	layouts->order.len   += count;
+
+	TypeLayout *members = make(TypeLayout, count + 1);
+	for_range (i, count) {
+		members[i] = *type_layout(layouts, leaf->members.arr[i].type);
+
+		if (members[i].align == 0) {
+			free(members);
+			return NO_LAYOUT;
+		}
+	}
+
+	u16 *order = &layouts->order.arr[fields];
+	for_range (i, count) {
+		u16 k = i;
+		for (; k > 0 && layouts->reorder && !merged && goes_before(layouts, id, members, i, order[k - 1]); k--) {
+			order[k] = order[k - 1];
+		}
+
+		order[k] = i;
+	}
+
+	TypeLayout layout = fixed(0, 1);
+	layout.fields     = fields;
+
+	for_range (k, count) {
+		const TypeLayout *member = &members[order[k]];
+		const u64         offset = merged ? 0 : align_up(layout.size, member->align);
+
+		layouts->offsets.arr[fields + order[k]] = offset;
+
+		if (member->align > layout.align)        layout.align = member->align;
+		if (offset + member->size > layout.size) layout.size  = offset + member->size;
+	}
+
+	layout.size = align_up(layout.size, layout.align);
+	free(members);
+	return layout;
+}
+
+// the struct or union a type ends in, without the modifiers around it
+static const TypeLayout *record_layout(Layouts *layouts, typeid type) {
+	const TypeLeaf *leaf = type_leaf(layouts->types, type);
+	if (leaf == NULL || (leaf->tag != DBLTP_STRUCT && leaf->tag != DBLTP_UNION)) return &NO_LAYOUT;
+
+	switch (cached(&layouts->records, type)->state) {
+		case LAYOUT_DONE: return &layouts->records.arr[type];
+		case LAYOUT_BUSY: return &NO_LAYOUT; // it holds itself
+		case LAYOUT_NONE: break;
+	}
+
+	layouts->records.arr[type].state = LAYOUT_BUSY;
+
+	// laying out members may have grown the cache
+	const TypeLayout layout    = layout_record(layouts, type, leaf);
+	layouts->records.arr[type] = layout;
+	return &layouts->records.arr[type];
+}
+
+// the leaf a type ends in, the name, function or struct the modifiers apply to
+static TypeLayout layout_base(Layouts *layouts, typeid id) {
+	const TypeLeaf *leaf = type_leaf(layouts->types, id);
+
+	switch (leaf->tag) {
+		case DBLTP_NAME: {
+			for_range (i, LAYOUT_SCALARS) {
+				if (leaf->name == layouts->scalars[i]) {
+					return fixed(SCALARS[i].size, SCALARS[i].size);
+				}
+			}
+
+			// aliases are declared on the name at the root, not on the one in
+			// *Node, which is a leaf of its own under the pointer
+			TypeLeaf named = { .tag = DBLTP_NAME, .name = leaf->name };
+			if (!leaf_exists(layouts->types, VOID_ID, &named)) return NO_LAYOUT;
+
+			const typeid root  = get_leaf(layouts->types, VOID_ID, &named);
+			const typeid canon = canonical_type(layouts->types, root);
+			return canon != root ? *type_layout(layouts, canon) : NO_LAYOUT;
+		}
+
+		case DBLTP_FN:
+			return fixed(PTR_SIZE, PTR_SIZE);
+
+		case DBLTP_STRUCT:
+		case DBLTP_UNION:
+			return *record_layout(layouts, id);
+
+		default:
+			return NO_LAYOUT;
+	}
+}
+
+/* path[0] is the outermost modifier. Everything but an array holds what it
+ * modifies through a pointer, so only arrays look further in, and *Node is
+ * laid out without Node:
+ *
+ *     ?T  { bool is_valid; T *opt; }
+ *     []T { T *arr; size_t len; }
+ *     [..]T { T *arr; size_t cap; size_t len; } */
+static TypeLayout layout_path(Layouts *layouts, const typeid *path, u32 len) {
+	if (len == 1) return layout_base(layouts, path[0]);
+
+	const TypeLeaf *outer = type_leaf(layouts->types, path[0]);
+	switch (outer->tag) {
+		case DBLTP_PTR:
+			return fixed(PTR_SIZE, PTR_SIZE);
+		case DBLTP_OPT:
+		case DBLTP_ERR:
+		case DBLTP_SLICE:
+			return fixed(PTR_SIZE * 2, PTR_SIZE);
+		case DBLTP_VEC:
+			return fixed(PTR_SIZE * 3, PTR_SIZE);
+
+		case DBLTP_ARR: {
+			const TypeLayout inner = layout_path(layouts, path + 1, len - 1);
+			return inner.align != 0 ? fixed(inner.size * outer->size, inner.align) : NO_LAYOUT;
+		}
+
+		// maps are not emitted yet
+		default:
+			return NO_LAYOUT;
+	}
+}
+
+const TypeLayout *type_layout(Layouts *layouts, typeid type) {
+	if (type == VOID_ID) return &NO_LAYOUT;
+
+	switch (cached(&layouts->layouts, type)->state) {
+		case LAYOUT_DONE: return &layouts->layouts.arr[type];
+		case LAYOUT_BUSY: return &NO_LAYOUT; // it holds itself
+		case LAYOUT_NONE: break;
+	}
+
+	layouts->layouts.arr[type].state = LAYOUT_BUSY;
+
+	typeid path[TYPE_DEPTH_MAX];
+	u32    depth = 0;
+	for (typeid at = type; at != VOID_ID; at = type_leaf(layouts->types, at)->parent) {
+		if (depth == TYPE_DEPTH_MAX) {
+			layouts->layouts.arr[type] = NO_LAYOUT;
+			return &layouts->layouts.arr[type];
+		}
+
+		path[depth++] = at;
+	}
+
+	// outermost first
+	for_range (i, depth / 2) {
+		const typeid swap      = path[i];
+		path[i]                = path[depth - 1 - i];
+		path[depth - 1 - i]    = swap;
+	}
+
+	// laying out members may have grown the cache
+	const TypeLayout layout    = layout_path(layouts, path, depth);
+	layouts->layouts.arr[type] = layout;
+	return &layouts->layouts.arr[type];
+}
+
+// 0 and declaration order for a struct without a layout. ztruct may have
+// modifiers, *struct {...} has the members of the struct
+u64 member_offset(Layouts *layouts, typeid ztruct, u16 member) {
+	const TypeLayout *layout = record_layout(layouts, ztruct);
+	if (layout->align == 0) return 0;
+
+	return layouts->offsets.arr[layout->fields + member];
+}
+
+u16 member_at(Layouts *layouts, typeid ztruct, u16 position) {
+	const TypeLayout *layout = record_layout(layouts, ztruct);
+	if (layout->align == 0) return position;
+
+	return layouts->order.arr[layout->fields + position];
+}
@@ -20,7 +20,7 @@ static void add_anon_member(AnonStruct *a, Member *member, GenCompiler *comp) {
 	EXTEND_ARR(TypePair, a->arr, a->len, a->cap);
 
 	a->arr[a->len++] = (TypePair) {
-		.a = copy_str(&member->name),
+		.a = init_str(symbol_str(member->name)),
 		.b = build_type(comp, member->type),
 	};
 }
@@ -51,13 +51,14 @@ static void add_anon_cmember(AnonStruct *a, CType *type, cstr name) {
  * I also do not want to build
  * */
 CType build_type(GenCompiler *comp, typeid id) {
-	if (id == NULL) {
+	if (id == VOID_ID) {
 		// NOTE: this just passes the buck of error handling up to the parser
 		// and AST passes.
 		PANIC("non existant type passed to build_type");
 	}
 
-	const TypeLeaf *type  = (TypeLeaf *) id;
+	const TypeLeaf *type  = type_leaf(comp->types, id);
+	typeid          at    = id; // of type
 	CType           ctype = make_ctype();
 
 	do {
@@ -80,7 +81,7 @@ CType build_type(GenCompiler *comp, typeid id) {
 					break;
 				}
 			case DBLTP_NAME:
-				add_name(&ctype, type->name.str);
+				add_name(&ctype, symbol_str(type->name));
 				break;
 
 			case DBLTP_UNION:
@@ -89,7 +90,8 @@ CType build_type(GenCompiler *comp, typeid id) {
 				{
 					AnonStruct *ztruct = create_anon_struct(comp);
 					for_range (i, type->members.len) {
-						add_anon_member(ztruct, &type->members.arr[i], comp);
+						const u16 member = comp->layouts.reorder ? member_at(&comp->layouts, at, i) : i;
+						add_anon_member(ztruct, &type->members.arr[member], comp);
 					}
 
 					ztruct->is_union = type->tag == DBLTP_UNION;
@@ -159,8 +161,9 @@ CType build_type(GenCompiler *comp, typeid id) {
 				break;
 		}
 
-		type = type->parent;
-	} while (type->parent != NULL);
+		at   = type->parent;
+		type = type_leaf(comp->types, at);
+	} while (type != NULL);
 
 	return ctype;
 }
@@ -0,0 +1,352 @@
+#include "internal.h"
+#include "type.h"
+#include "../strutils/str.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Front end throughput benchmarks, built and run with the bench flag.
+ *
+ * A few shapes of synthetic source are generated at a given size, then lexed
+ * with get_tokens and parsed with get_ast. Every phase runs a few times and the
+ * fastest run is kept along with the allocations it made, lexing counts them
+ * on a run of its own with a single thread. The results are compared against
+ * a baseline file, so a change that makes the front end slower or hungrier
+ * shows up as a regression.
+ *
+ *     bench [KiB per source] [save]
+ *
+ * save replaces the baseline with this run. Allocations are counted by the
+ * wrappers in testing.c, so a baseline only compares against the same size. */
+
+#define BENCH_BASELINE  "dooble/bench.json"
+#define BENCH_KIB       1024
+#define BENCH_RUNS      5
+#define BENCH_TOLERANCE 0.10 // how much worse than the baseline still passes
+#define BENCH_NAME_LEN  64
+#define BENCH_LINE_LEN  256
+
+#define EXPR_DEPTH    32
+#define CALL_CHAIN    24
+#define STRUCT_FIELDS 16
+
+typedef struct {
+	char   name[BENCH_NAME_LEN]; // "<source>/<phase>"
+	double mb_s;
+	double tokens_s;
+	double nodes_s;
+	size_t peak_bytes;
+	size_t mallocs;
+} BenchResult;
+
+typedef VEC(BenchResult) BenchResults;
+
+// appends the i-th unit of a source, generators are called until it is big enough
+typedef void (*Generator)(string_t *src, u32 i);
+
+static void gen_expr_nest(string_t *src, u32 i) {
+	static const char ops[] = "+-*/";
+
+	concatf_cstr(src, "e%u := ", i);
+	for_range (d, EXPR_DEPTH) addchar(src, '(');
+
+	concatf_cstr(src, "a%u", i);
+	for_range (d, EXPR_DEPTH) concatf_cstr(src, " %c %d)", ops[d % 4], d + 1);
+
+	addchar(src, '\n');
+}
+
+static void gen_decls(string_t *src, u32 i) {
+	concatf_cstr(src, "f%u :: () {\n", i);
+	concatf_cstr(src, "\tx := a%u + %u\n", i, i);
+	concat_cstr (src, "\ty: *[]int = x * 2\n");
+	concat_cstr (src, "\tprint(x, y)\n");
+	concat_cstr (src, "}\n");
+}
+
+static void gen_call_chain(string_t *src, u32 i) {
+	concatf_cstr(src, "c%u := a", i);
+	for_range (d, CALL_CHAIN) concatf_cstr(src, ".m%d(%d, x)", d, d);
+
+	addchar(src, '\n');
+}
+
+static void gen_structs(string_t *src, u32 i) {
+	static const char *field_types[] = {
+		"int", "*[]Node", "?int", "[4]*Node", "?*[]u8", "(int, *Node) -> bool",
+	};
+
+	concatf_cstr(src, "S%u :: struct {\n", i);
+	for_range (f, STRUCT_FIELDS) {
+		concatf_cstr(src, "\tf%d: ", f);
+		concat_cstr (src, field_types[f % (LEN(field_types))]);
+		addchar(src, '\n');
+	}
+
+	concat_cstr(src, "}\n");
+}
+
+static const struct {
+	const char *name;
+	Generator   gen;
+} SOURCES[] = {
+	{ "expr_nest",  gen_expr_nest  },
+	{ "decls",      gen_decls      },
+	{ "call_chain", gen_call_chain },
+	{ "structs",    gen_structs    },
+};
+
+static string_t generate(Generator gen, size_t bytes) {
+	string_t src = init_str("");
+	for (u32 i = 0; src.size < bytes; i++) gen(&src, i);
+
+	return src;
+}
+
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// keeps the fastest run, and the allocations of that run
+static void keep_best(double *best, double time, BenchResult *result, size_t base) {
+	if (time >= *best) return;
+
+	*best              = time;
+	result->mallocs    = alloc_stats.calls;
+	result->peak_bytes = alloc_stats.peak - base;
+}
+
+static BenchResult bench_tokens(const char *name, const string_t *src, size_t *tokens) {
+	BenchResult result = {};
+	double      best   = INFINITY;
+	snprintf(result.name, BENCH_NAME_LEN, "%s/get_tokens", name);
+
+	for_range (run, BENCH_RUNS) {
+		const double start = now();
+		TokenStream  ts    = get_tokens(src->str);
+		const double time  = now() - start;
+		if (time < best) best = time;
+
+		*tokens = ts.len;
+		free_tokens(&ts);
+	}
+
+	// the allocation counters are not atomic, so they are read from a run
+	// that lexes the same chunks on this thread alone
+	const size_t base = alloc_stats.bytes;
+	reset_alloc_stats();
+	limit_lex_threads(1);
+
+	TokenStream ts = get_tokens(src->str);
+	result.mallocs    = alloc_stats.calls;
+	result.peak_bytes = alloc_stats.peak - base;
+
+	limit_lex_threads(0);
+	free_tokens(&ts);
+
+	result.mb_s     = src->size / best / 1e6;
+	result.tokens_s = *tokens / best;
+	return result;
+}
+
+static BenchResult bench_ast(const char *name, const string_t *src, size_t tokens, bool *ok) {
+	BenchResult result = {};
+	double      best   = INFINITY;
+	size_t      nodes  = 0;
+	snprintf(result.name, BENCH_NAME_LEN, "%s/get_ast", name);
+
+	for_range (run, BENCH_RUNS) {
+		LineTable lines = init_line_table(src->str, src->size);
+		TypeTree  tree  = init_TypeTree();
+
+		const size_t base = alloc_stats.bytes;
+		reset_alloc_stats();
+
+		const double start = now();
+		Lexer        lexer = init_lexer(src->str, src->size, &lines);
+		AstResult    ast   = get_ast(&lexer, &tree);
+		keep_best(&best, now() - start, &result, base);
+
+		*ok  &= ast.err == PARSE_OK;
+		nodes = ast.pool_size;
+
+		free_ast(&ast);
+		freetree(&tree);
+		free_line_table(&lines);
+	}
+
+	result.mb_s     = src->size / best / 1e6;
+	result.tokens_s = tokens / best;
+	result.nodes_s  = nodes / best;
+	return result;
+}
+
+// == baseline ==
+
+static void print_result(const BenchResult *result) {
+	printf("%-24s %9.2f %9.2f %9.2f %11zu %9zu\n", result->name,
+			result->mb_s, result->tokens_s / 1e6, result->nodes_s / 1e6,
+			result->peak_bytes / 1024, result->mallocs);
+}
+
+/* The baseline is a JSON object with one result per line, so it is read back
+ * a line at a time without a JSON parser:
+ *
+ * {
+ *     "kib": 1024,
+ *     "expr_nest/get_tokens": { "mb_s": 1.5, "tokens_s": ..., "mallocs": 8 },
+ *     ...
+ * } */
+static bool load_baseline(BenchResults *results, u32 *kib) {
+	FILE *file = fopen(BENCH_BASELINE, "rb");
+	if (file == NULL) return false;
+
+	char line[BENCH_LINE_LEN];
+	while (fgets(line, BENCH_LINE_LEN, file) != NULL) {
+		BenchResult result = {};
+
+		if (sscanf(line, " \"kib\": %u", kib) == 1) continue;
+
+		int read = sscanf(line,
+				" \"%63[^\"]\": { \"mb_s\": %lf, \"tokens_s\": %lf, \"nodes_s\": %lf,"
+				" \"peak_bytes\": %zu, \"mallocs\": %zu }",
+				result.name, &result.mb_s, &result.tokens_s, &result.nodes_s,
+				&result.peak_bytes, &result.mallocs);
+		if (read != 6) continue;
+
+		EXTEND_ARR(BenchResult, results->arr, results->len, results->cap);
+		results->arr[results->len++] = result;
+	}
+
+	fclose(file);
+	return true;
+}
+
+static bool save_baseline(const BenchResults *results, u32 kib) {
+	string_t json = init_str("");
+	concatf_cstr(&json, "{\n\t\"kib\": %u", kib);
+
+	for_range (i, results->len) {
+		const BenchResult *result = &results->arr[i];
+		concat_cstr (&json, ",\n\t\"");
+		concat_cstr (&json, result->name);
+		concat_cstr (&json, "\": { ");
+		concatf_cstr(&json, "\"mb_s\": %.3f, \"tokens_s\": %.0f, \"nodes_s\": %.0f, ",
+				result->mb_s, result->tokens_s, result->nodes_s);
+		concatf_cstr(&json, "\"peak_bytes\": %zu, \"mallocs\": %zu }",
+				result->peak_bytes, result->mallocs);
+	}
+
+	concat_cstr(&json, "\n}\n");
+
+	const bool written = write_file(&json, BENCH_BASELINE);
+	freestr(&json);
+	return written;
+}
+
+static bool worse(double value, double baseline, bool higher_is_better) {
+	return higher_is_better
+		? value < baseline * (1 - BENCH_TOLERANCE)
+		: value > baseline * (1 + BENCH_TOLERANCE);
+}
+
+// tokens/s and nodes/s move with MB/s, only the throughput of bytes is checked
+static u32 compare(const BenchResult *result, const BenchResults *baseline) {
+	for_range (i, baseline->len) {
+		const BenchResult *base = &baseline->arr[i];
+		if (strcmp(base->name, result->name) != 0) continue;
+
+		u32 regressions = 0;
+		if (worse(result->mb_s, base->mb_s, true)) {
+			printf("\tregression in %s: %.2f MB/s, was %.2f\n",
+					result->name, result->mb_s, base->mb_s);
+			regressions++;
+		}
+
+		if (worse(result->peak_bytes, base->peak_bytes, false)) {
+			printf("\tregression in %s: %zu peak bytes, was %zu\n",
+					result->name, result->peak_bytes, base->peak_bytes);
+			regressions++;
+		}
+
+		if (worse(result->mallocs, base->mallocs, false)) {
+			printf("\tregression in %s: %zu mallocs, was %zu\n",
+					result->name, result->mallocs, base->mallocs);
+			regressions++;
+		}
+
+		return regressions;
+	}
+
+	return 0;
+}
+
+int dooble_bench(int argc, char **argv) {
+	u32  kib  = BENCH_KIB;
+	bool save = false;
+
+	for_range (i, argc) {
+		if (strcmp(argv[i], "save") == 0) save = true;
+		else                              kib  = strtoul(argv[i], NULL, 10);
+	}
+
+	if (kib == 0) {
+		error("bench: the size of a source must be a positive number of KiB");
+		return 1;
+	}
+
+	BenchResults baseline = { .arr = make(BenchResult, LEN(SOURCES) * 2), .cap = LEN(SOURCES) * 2 };
+	BenchResults results  = { .arr = make(BenchResult, LEN(SOURCES) * 2), .cap = LEN(SOURCES) * 2 };
+
+	u32  baseline_kib = 0;
+	bool compared     = !save && load_baseline(&baseline, &baseline_kib);
+	if (compared && baseline_kib != kib) {
+		printf("baseline was recorded with %u KiB sources, not comparing\n", baseline_kib);
+		compared = false;
+	}
+
+	printf("%-24s %9s %9s %9s %11s %9s\n",
+			"benchmark", "MB/s", "Mtok/s", "Mnode/s", "peak KiB", "mallocs");
+
+	u32 regressions = 0;
+	for_range (i, LEN(SOURCES)) {
+		string_t src    = generate(SOURCES[i].gen, (size_t) kib * 1024);
+		size_t   tokens = 0;
+		bool     parsed = true;
+
+		BenchResult phases[] = {
+			bench_tokens(SOURCES[i].name, &src, &tokens),
+			bench_ast(SOURCES[i].name, &src, tokens, &parsed),
+		};
+
+		if (!parsed) {
+			error("bench: the %s source did not parse", SOURCES[i].name);
+			regressions++;
+		}
+
+		for_range (j, LEN(phases)) {
+			print_result(&phases[j]);
+			if (compared) regressions += compare(&phases[j], &baseline);
+
+			EXTEND_ARR(BenchResult, results.arr, results.len, results.cap);
+			results.arr[results.len++] = phases[j];
+		}
+
+		freestr(&src);
+	}
+
+	if (save && save_baseline(&results, kib)) {
+		printf("baseline saved to %s\n", BENCH_BASELINE);
+	}
+	else if (compared) {
+		printf("%u regressions against %s\n", regressions, BENCH_BASELINE);
+	}
+
+	free(baseline.arr);
+	free(results.arr);
+	return regressions;
+}
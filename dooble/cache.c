@@ -0,0 +1,593 @@
+#include "internal.h"
+#include "type.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A cache file is a CompactAst written out as is, so loading one is a single
+ * map_file and the node arrays are used straight from the mapping.
+ *
+ * header | tags | flags | data | extra | text | symbol ends | names | type starts | type words
+ *
+ * Every section starts on an 8 byte boundary. Node arrays only hold indices,
+ * the two tables that point outside the module are rebuilt on load instead:
+ * symbols are stored as their text and interned again, types are stored as
+ * the path of leaves from the root of the TypeTree and looked up again with
+ * get_leaf. Both are one entry per distinct name or type, not per node.
+ *
+ * The layout is the one of the machine that wrote it, a cache is never meant
+ * to leave it.
+ *
+ * A hit needs the length and a second, unrelated hash of the source to match
+ * too, and the whole file is checked before anything is interned or added to
+ * the tree, so a stale or broken file is a miss that leaves no trace. */
+
+#define CACHE_MAGIC   0x434C4244 // "DBLC"
+#define CACHE_VERSION 3
+#define CACHE_ALIGN   8
+#define WORDS_INIT    64
+#define NESTING_MAX   256 // types inside types, a deeper one is taken as broken
+
+typedef struct {
+	u32 magic;
+	u32 version;
+	u64 hash;       // of the source, the file is named after it too
+	u32 nodes;
+	u32 extra;
+	u32 text;       // bytes
+	u32 symbols;
+	u32 names;      // bytes of symbol text
+	u32 types;
+	u32 type_words;
+	u32 length;     // of the source
+	u64 check;      // source_check of the source
+} CacheHeader;
+
+typedef VEC(u32) Words;
+
+// FNV-1a
+u64 source_hash(const char *buffer, u32 len) {
+	u64 hash = 0xcbf29ce484222325;
+
+	for_range (i, len) {
+		hash ^= (u8) buffer[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+// a multiply-rotate hash seeded with the length, shares nothing with FNV
+static u64 source_check(const char *buffer, u32 len) {
+	u64 hash = 0x9e3779b97f4a7c15 ^ len;
+
+	for_range (i, len) {
+		hash  = (hash << 5 | hash >> 59) ^ (u8) buffer[i];
+		hash *= 0xff51afd7ed558ccd;
+	}
+
+	return hash ^ hash >> 33;
+}
+
+bool ast_cache_path(char *out, size_t size, cstr dir, u64 hash) {
+	const int len = snprintf(out, size, "%s/%016llx.dbc", dir, (unsigned long long) hash);
+	return len > 0 && (size_t) len < size;
+}
+
+// === WRITING ===
+
+static void push_word(Words *words, u32 word) {
+	if (words->len >= words->cap) {
+		words->cap = words->cap ? words->cap * 2 : WORDS_INIT;
+
+		void *tmp = realloc(words->arr, sizeof(u32) * words->cap);
+		if (tmp == NULL) PANIC("could not extend ast cache");
+		words->arr = tmp;
+	}
+
+	words->arr[words->len++] = word;
+}
+
+// length, then the text packed into words
+static void encode_name(Words *words, Symbol sym) {
+	const u32 len = symbol_len(sym);
+	push_word(words, len);
+
+	for (u32 i = 0; i < len; i += sizeof(u32)) {
+		u32 word = 0;
+		memcpy(&word, &symbol_str(sym)[i], len - i < sizeof(u32) ? len - i : sizeof(u32));
+		push_word(words, word);
+	}
+}
+
+static void encode_type(Words *words, const TypeTree *tree, typeid type);
+
+// the parents first, so decoding can rebuild the path from the root down
+static void encode_path(Words *words, const TypeTree *tree, typeid type) {
+	const TypeLeaf *leaf = type_leaf(tree, type);
+	if (leaf == NULL) return;
+	encode_path(words, tree, leaf->parent);
+
+	push_word(words, leaf->tag);
+	switch (leaf->tag) {
+		case DBLTP_ARR:
+			push_word(words, (u32) leaf->size);
+			push_word(words, (u32) ((u64) leaf->size >> 32));
+			break;
+
+		case DBLTP_NAME:
+			encode_name(words, leaf->name);
+			break;
+
+		case DBLTP_MAP:
+			encode_type(words, tree, leaf->map.key);
+			encode_type(words, tree, leaf->map.val);
+			break;
+
+		case DBLTP_FN:
+			encode_type(words, tree, leaf->fn.ret);
+			push_word(words, leaf->fn.len);
+			for_range (i, leaf->fn.len) encode_type(words, tree, leaf->fn.arr[i]);
+			break;
+
+		case DBLTP_STRUCT:
+		case DBLTP_UNION:
+			push_word(words, leaf->members.named != NO_SYMBOL);
+			if (leaf->members.named != NO_SYMBOL) encode_name(words, leaf->members.named);
+
+			push_word(words, leaf->members.len);
+			for_range (i, leaf->members.len) {
+				encode_name(words, leaf->members.arr[i].name);
+				encode_type(words, tree, leaf->members.arr[i].type);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+// number of leaves, then the leaves. VOID_ID has none
+static void encode_type(Words *words, const TypeTree *tree, typeid type) {
+	u32 depth = 0;
+	for (typeid id = type; id != VOID_ID; id = type_leaf(tree, id)->parent) depth++;
+
+	push_word(words, depth);
+	encode_path(words, tree, type);
+}
+
+static size_t align_up(size_t size) {
+	return (size + CACHE_ALIGN - 1) & ~(size_t) (CACHE_ALIGN - 1);
+}
+
+// copies a section in and pads it to the next boundary, the buffer is zeroed
+static void put_section(char *buffer, size_t *at, const void *data, size_t size) {
+	if (size > 0) memcpy(&buffer[*at], data, size);
+	*at = align_up(*at + size);
+}
+
+bool save_ast_cache(cstr dir, const char *source, u32 len, const TypeTree *tree, const CompactAst *ast) {
+	const u64 hash = source_hash(source, len);
+
+	char path[FILENAME_MAX];
+	if (!ast_cache_path(path, sizeof(path), dir, hash)) return false;
+
+	// names are packed back to back, each symbol records where its own ends
+	u32 name_bytes = 0;
+	for_range (i, ast->symbols.len) name_bytes += symbol_len(compact_symbol(ast, i));
+
+	char *names = make(char, name_bytes + 1);
+	u32  *ends  = make(u32, ast->symbols.len + 1);
+	u32   end   = 0;
+
+	for_range (i, ast->symbols.len) {
+		const Symbol sym = compact_symbol(ast, i);
+
+		memcpy(&names[end], symbol_str(sym), symbol_len(sym));
+		end    += symbol_len(sym);
+		ends[i] = end;
+	}
+
+	u32  *starts = make(u32, ast->types.len + 1);
+	Words types  = {0};
+	for_range (i, ast->types.len) {
+		starts[i] = types.len;
+		encode_type(&types, tree, ast->types.arr[i]);
+	}
+
+	if (names == NULL || ends == NULL || starts == NULL) PANIC("could not allocate ast cache");
+
+	const CacheHeader header = {
+		.magic      = CACHE_MAGIC,
+		.version    = CACHE_VERSION,
+		.hash       = hash,
+		.nodes      = ast->len,
+		.extra      = ast->extra.len,
+		.text       = ast->text.len,
+		.symbols    = ast->symbols.len,
+		.names      = name_bytes,
+		.types      = ast->types.len,
+		.type_words = types.len,
+		.length     = len,
+		.check      = source_check(source, len),
+	};
+
+	const size_t size = align_up(sizeof(CacheHeader))
+		+ align_up(sizeof(u8) * ast->len) * 2
+		+ align_up(sizeof(NodeData) * ast->len)
+		+ align_up(sizeof(u32) * ast->extra.len)
+		+ align_up(ast->text.len)
+		+ align_up(sizeof(u32) * ast->symbols.len)
+		+ align_up(name_bytes)
+		+ align_up(sizeof(u32) * ast->types.len)
+		+ align_up(sizeof(u32) * types.len);
+
+	char  *buffer = make(char, size);
+	size_t at     = 0;
+	if (buffer == NULL) PANIC("could not allocate ast cache");
+
+	put_section(buffer, &at, &header,        sizeof(header));
+	put_section(buffer, &at, ast->tags,      sizeof(u8) * ast->len);
+	put_section(buffer, &at, ast->flags,     sizeof(u8) * ast->len);
+	put_section(buffer, &at, ast->data,      sizeof(NodeData) * ast->len);
+	put_section(buffer, &at, ast->extra.arr, sizeof(u32) * ast->extra.len);
+	put_section(buffer, &at, ast->text.arr,  ast->text.len);
+	put_section(buffer, &at, ends,           sizeof(u32) * ast->symbols.len);
+	put_section(buffer, &at, names,          name_bytes);
+	put_section(buffer, &at, starts,         sizeof(u32) * ast->types.len);
+	put_section(buffer, &at, types.arr,      sizeof(u32) * types.len);
+	DYNAMIC_ASSERT(at == size, "ast cache sections do not add up");
+
+	string_t file = { .str = buffer, .size = size, .capacity = size };
+	const bool written = write_file(&file, path);
+
+	free(buffer);
+	free(names);
+	free(ends);
+	free(starts);
+	free(types.arr);
+	return written;
+}
+
+// === LOADING ===
+
+typedef struct {
+	const u32 *words;
+	u32        pos;
+	u32        len;
+	u32        nesting;
+	bool       broken; // read past the end, the file is not trusted after that
+	TypeTree  *tree;   // NULL only walks the words to check them
+} WordReader;
+
+static u32 next_word(WordReader *r) {
+	if (r->pos >= r->len) {
+		r->broken = true;
+		return 0;
+	}
+
+	return r->words[r->pos++];
+}
+
+// a count of things that each take at least a word can't be more than are left
+static u32 next_count(WordReader *r) {
+	const u32 count = next_word(r);
+	if (count > r->len - r->pos) r->broken = true;
+	return r->broken ? 0 : count;
+}
+
+static Symbol decode_name(WordReader *r) {
+	const u32 len   = next_word(r);
+	const u32 words = (len + sizeof(u32) - 1) / sizeof(u32);
+
+	if (r->broken || words > r->len - r->pos) {
+		r->broken = true;
+		return NO_SYMBOL;
+	}
+
+	const Symbol sym = r->tree ? intern((const char *) &r->words[r->pos], len) : NO_SYMBOL;
+	r->pos += words;
+	return sym;
+}
+
+static typeid decode_type(WordReader *r) {
+	const u32 depth = next_count(r);
+	typeid    leaf  = VOID_ID;
+
+	if (++r->nesting > NESTING_MAX) r->broken = true;
+
+	for (u32 d = 0; d < depth && !r->broken; d++) {
+		const u32 tag = next_word(r);
+		if (tag > DBLTP_UNION) r->broken = true;
+
+		TypeLeaf next = { .tag = tag };
+
+		switch (next.tag) {
+			case DBLTP_ARR: {
+				const u64 low = next_word(r);
+				next.size = low | (u64) next_word(r) << 32;
+				break;
+			}
+
+			case DBLTP_NAME:
+				next.name = decode_name(r);
+				break;
+
+			case DBLTP_MAP:
+				next.map.key = decode_type(r);
+				next.map.val = decode_type(r);
+				break;
+
+			case DBLTP_FN:
+				next.fn.ret = decode_type(r);
+				next.fn.len = next_count(r);
+				next.fn.cap = next.fn.len;
+				if (r->tree) next.fn.arr = make(typeid, next.fn.len + 1);
+
+				for_range (i, next.fn.len) {
+					const typeid arg = decode_type(r);
+					if (r->tree) next.fn.arr[i] = arg;
+				}
+				break;
+
+			case DBLTP_STRUCT:
+			case DBLTP_UNION:
+				if (next_word(r)) next.members.named = decode_name(r);
+
+				next.members.len = next_count(r);
+				next.members.cap = next.members.len;
+				if (r->tree) next.members.arr = make(Member, next.members.len + 1);
+
+				for_range (i, next.members.len) {
+					const Symbol name = decode_name(r);
+					const typeid type = decode_type(r);
+					if (r->tree) next.members.arr[i] = (Member) { .name = name, .type = type };
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		// get_leaf copies the arrays of a new leaf, these were only for the lookup
+		if (!r->broken && r->tree) leaf = get_leaf(r->tree, leaf, &next);
+
+		if (next.tag == DBLTP_FN) free(next.fn.arr);
+		if (next.tag == DBLTP_STRUCT || next.tag == DBLTP_UNION) free(next.members.arr);
+	}
+
+	r->nesting--;
+	return leaf;
+}
+
+/* Every index a node holds is checked once here, so print and walk can trust
+ * the arrays of a loaded ast like they do a built one. Children come after
+ * their parent (see compact_ast), which also keeps a walk from looping. */
+typedef struct {
+	const CompactAst *ast;
+	NodeIndex         node;
+	bool              broken;
+} NodeChecker;
+
+static void check_child(NodeChecker *c, u32 child) {
+	c->broken |= child != NO_NODE && (child <= c->node || child >= c->ast->len);
+}
+
+static void check_range(NodeChecker *c, u32 start, u32 len) {
+	c->broken |= (u64) start + len > c->ast->extra.len;
+}
+
+static void check_index(NodeChecker *c, u32 index, u32 len) {
+	c->broken |= index >= len;
+}
+
+// `start` has to be checked already, the children are only read if they fit
+static void check_children(NodeChecker *c, u32 start, u32 len) {
+	check_range(c, start, len);
+	if (c->broken) return;
+
+	for_range (i, len) check_child(c, c->ast->extra.arr[start + i]);
+}
+
+static bool check_nodes(const CompactAst *ast) {
+	const u32  *extra = ast->extra.arr;
+	NodeChecker c     = { .ast = ast };
+
+	for (c.node = 0; c.node < ast->len && !c.broken; c.node++) {
+		const NodeData data = ast->data[c.node];
+
+		switch (ast->tags[c.node]) {
+			case EX_PASS:
+				break;
+
+			case EX_IF:
+				check_child(&c, data.lhs);
+				check_children(&c, data.rhs, 2);
+				break;
+
+			case EX_FOREACH:
+			case EX_DOEACH:
+			case EX_DONTEACH:
+				check_range(&c, data.lhs, 2);
+				if (c.broken) break;
+
+				check_index(&c, extra[data.lhs], ast->symbols.len);
+				check_child(&c, extra[data.lhs + 1]);
+				check_child(&c, data.rhs);
+				break;
+
+			case EX_FORWHILE:
+			case EX_DOWHILE:
+			case EX_DONTWHILE:
+			case EX_BINOP:
+				check_child(&c, data.lhs);
+				check_child(&c, data.rhs);
+				break;
+
+			case EX_BLOCK:
+				check_children(&c, data.lhs, data.rhs);
+				break;
+
+			case EX_DECL:
+				check_range(&c, data.lhs, 2);
+				if (c.broken) break;
+
+				check_index(&c, extra[data.lhs],     ast->symbols.len);
+				check_index(&c, extra[data.lhs + 1], ast->types.len);
+				check_child(&c, data.rhs);
+				break;
+
+			case EX_UNARY:
+				check_child(&c, data.lhs);
+				break;
+
+			case EX_CALL:
+				check_child(&c, data.lhs);
+				check_range(&c, data.rhs, 1);
+				if (c.broken) break;
+
+				check_children(&c, data.rhs + 1, extra[data.rhs]);
+				break;
+
+			case EX_SUBMEMBER:
+				check_child(&c, data.lhs);
+				check_index(&c, data.rhs, ast->symbols.len);
+				break;
+
+			case EX_FUNCTION:
+				check_child(&c, data.lhs);
+				check_range(&c, data.rhs, 2);
+				if (c.broken) break;
+
+				check_index(&c, extra[data.rhs], ast->types.len);
+				check_children(&c, data.rhs + 2, extra[data.rhs + 1]);
+				break;
+
+			case EX_LITERAL:
+				switch (ast->flags[c.node]) {
+					case LIT_STR:   c.broken |= (u64) data.lhs + data.rhs > ast->text.len; break;
+					case LIT_IDENT: check_index(&c, data.lhs, ast->symbols.len);        break;
+					case LIT_BOOL:
+					case LIT_NUM:
+					case LIT_FLT:
+					case LIT_NIL:   break;
+					default:        c.broken = true;
+				}
+				break;
+
+			default:
+				c.broken = true;
+		}
+	}
+
+	return !c.broken;
+}
+
+// hands out the sections of a mapped file in order, NULL once they run past it
+static const void *take_section(const FileView *view, size_t *at, size_t size) {
+	if (*at + size > view->len) return NULL;
+
+	const void *section = &view->data[*at];
+	*at = align_up(*at + size);
+	return section;
+}
+
+bool load_ast_cache(cstr dir, const char *source, u32 len, TypeTree *tree, CompactAst *out) {
+	const u64 hash = source_hash(source, len);
+
+	char path[FILENAME_MAX];
+	if (!ast_cache_path(path, sizeof(path), dir, hash)) return false;
+
+	// a missing file is an ordinary miss, not worth a message
+	mute_errors(true);
+	FileView view = map_file(path);
+	mute_errors(false);
+
+	if (view.data == NULL) return false;
+
+	size_t at = 0;
+	const CacheHeader *header = take_section(&view, &at, sizeof(CacheHeader));
+
+	// there is always a root
+	if (header == NULL
+			|| header->magic   != CACHE_MAGIC
+			|| header->version != CACHE_VERSION
+			|| header->hash    != hash
+			|| header->length  != len
+			|| header->check   != source_check(source, len)
+			|| header->nodes   == 0)
+	{
+		unmap_file(&view);
+		return false;
+	}
+
+	// the mapping is read only, the arrays are never written through
+	u8         *tags   = (u8 *)       take_section(&view, &at, sizeof(u8) * header->nodes);
+	u8         *flags  = (u8 *)       take_section(&view, &at, sizeof(u8) * header->nodes);
+	NodeData   *data   = (NodeData *) take_section(&view, &at, sizeof(NodeData) * header->nodes);
+	u32        *extra  = (u32 *)      take_section(&view, &at, sizeof(u32) * header->extra);
+	char       *text   = (char *)     take_section(&view, &at, header->text);
+	const u32  *ends   = take_section(&view, &at, sizeof(u32) * header->symbols);
+	const char *names  = take_section(&view, &at, header->names);
+	const u32  *starts = take_section(&view, &at, sizeof(u32) * header->types);
+	const u32  *words  = take_section(&view, &at, sizeof(u32) * header->type_words);
+
+	if (!tags || !flags || !data || !extra || !text || !ends || !names || !starts || !words) {
+		unmap_file(&view);
+		return false;
+	}
+
+	CompactAst ast = {
+		.tags  = tags,
+		.flags = flags,
+		.data  = data,
+		.len   = header->nodes,
+		.cap   = header->nodes,
+		.extra = { .arr = extra, .len = header->extra, .cap = header->extra },
+		.text  = { .arr = text,  .len = header->text,  .cap = header->text },
+		.view  = view,
+	};
+
+	// check_nodes only needs the table sizes, the tables come after the checks
+	ast.symbols.len = header->symbols;
+	ast.symbols.cap = header->symbols;
+	ast.types.len   = header->types;
+	ast.types.cap   = header->types;
+
+	bool broken = false;
+	u32  start  = 0;
+	for (u32 i = 0; i < header->symbols && !broken; i++) {
+		broken |= ends[i] < start || ends[i] > header->names;
+		start   = ends[i];
+	}
+
+	WordReader reader = { .words = words, .len = header->type_words };
+	for (u32 i = 0; i < header->types && !broken; i++) {
+		reader.pos = starts[i];
+		decode_type(&reader);
+		broken |= reader.broken;
+	}
+
+	// a truncated or corrupt file is only a miss
+	if (broken || !check_nodes(&ast)) {
+		free_compact_ast(&ast);
+		return false;
+	}
+
+	ast.symbols.arr = make(Symbol, header->symbols + 1);
+	start           = 0;
+	for_range (i, header->symbols) {
+		ast.symbols.arr[i] = intern(&names[start], ends[i] - start);
+		start              = ends[i];
+	}
+
+	ast.types.arr = make(typeid, header->types + 1);
+	reader.tree   = tree;
+	for_range (i, header->types) {
+		reader.pos       = starts[i];
+		ast.types.arr[i] = decode_type(&reader);
+	}
+
+	*out = ast;
+	return true;
+}
@@ -0,0 +1,271 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EXTRA_INIT_SIZE  64
+#define SYMBOL_INIT_SLOTS 64 // power of 2
+
+// makes room for `count` more items at the end of a VEC, returns where they start
+#define RESERVE(vec, count) \
+	reserve((void **) &(vec).arr, &(vec).len, &(vec).cap, sizeof(*(vec).arr), count)
+
+static u32 reserve(void **arr, size_t *len, size_t *cap, size_t size, size_t count) {
+	if (*len + count > *cap) {
+		while (*len + count > *cap) *cap = *cap ? *cap * 2 : EXTRA_INIT_SIZE;
+
+		void *tmp = realloc(*arr, size * *cap);
+		if (tmp == NULL) PANIC("could not extend compact ast");
+		*arr = tmp;
+	}
+
+	*len += count;
+	return *len - count;
+}
+
+// lowering a child can move extra, so it is only indexed once the child is done
+static void set_extra(CompactAst *ast, u32 index, u32 value) {
+	ast->extra.arr[index] = value;
+}
+
+static void grow_symbol_slots(CompactAst *ast) {
+	const u32 cap = (ast->slot_mask + 1) * 2;
+
+	free(ast->symbol_slots);
+	ast->symbol_slots = make(u32, cap);
+	ast->slot_mask    = cap - 1;
+	if (ast->symbol_slots == NULL) PANIC("could not extend compact ast symbols");
+
+	for_range (i, ast->symbols.len) {
+		u32 slot = ast->symbols.arr[i] & ast->slot_mask;
+		while (ast->symbol_slots[slot] != 0) slot = (slot + 1) & ast->slot_mask;
+
+		ast->symbol_slots[slot] = i + 1;
+	}
+}
+
+// the module's own index for a symbol, handed out in order of first use
+static u32 local_symbol(CompactAst *ast, Symbol sym) {
+	u32 slot = sym & ast->slot_mask;
+
+	for (; ast->symbol_slots[slot] != 0; slot = (slot + 1) & ast->slot_mask) {
+		const u32 index = ast->symbol_slots[slot] - 1;
+		if (ast->symbols.arr[index] == sym) return index;
+	}
+
+	const u32 index = RESERVE(ast->symbols, 1);
+	ast->symbols.arr[index] = sym;
+	ast->symbol_slots[slot]  = index + 1;
+
+	// kept at most half full
+	if (ast->symbols.len * 2 > ast->slot_mask + 1) grow_symbol_slots(ast);
+
+	return index;
+}
+
+static u32 push_type(CompactAst *ast, typeid type) {
+	const u32 i = RESERVE(ast->types, 1);
+	ast->types.arr[i] = type;
+	return i;
+}
+
+static NodeData push_text(CompactAst *ast, const string_t *str) {
+	const u32 start = RESERVE(ast->text, str->size);
+	memcpy(&ast->text.arr[start], str->str, str->size);
+
+	return (NodeData) { .lhs = start, .rhs = str->size };
+}
+
+static NodeData split_u64(u64 value) {
+	return (NodeData) { .lhs = (u32) value, .rhs = (u32) (value >> 32) };
+}
+
+static u8 decl_flags(const Declaration *d) {
+	return (d->is_const         ? DECL_CONST   : 0)
+		| (d->quals.is_static  ? DECL_STATIC  : 0)
+		| (d->quals.is_pub     ? DECL_PUB     : 0)
+		| (d->quals.is_co      ? DECL_CO      : 0)
+		| (d->quals.is_protect ? DECL_PROTECT : 0)
+		| (d->quals.is_final   ? DECL_FINAL   : 0);
+}
+
+/* The node takes its index before any of its children, which is what keeps
+ * the layout in pre order. extra is reserved up front and filled in as the
+ * children are lowered, it may move in the meantime so only indices into it
+ * are kept. */
+static NodeIndex lower(CompactAst *ast, const Node *node) {
+	if (node == NULL) return NO_NODE;
+
+	DYNAMIC_ASSERT(ast->len < ast->cap, "ast has more nodes than its pool");
+	const NodeIndex i = ast->len++;
+
+	ast->tags[i]  = node->tag;
+	ast->flags[i] = 0;
+
+	NodeData data = {0};
+	u32      extra;
+
+	switch (node->tag) {
+		case EX_PASS:
+			break;
+
+		case EX_IF:
+			extra    = RESERVE(ast->extra, 2);
+			data.lhs = lower(ast, node->ifstmt.condition);
+			data.rhs = extra;
+			set_extra(ast, extra,     lower(ast, node->ifstmt.stmt));
+			set_extra(ast, extra + 1, lower(ast, node->ifstmt.else_case));
+			break;
+
+		case EX_FOREACH:
+		case EX_DOEACH:
+		case EX_DONTEACH:
+			extra         = RESERVE(ast->extra, 2);
+			ast->flags[i] = node->foreach.by_reference;
+			data.lhs      = extra;
+
+			set_extra(ast, extra,     local_symbol(ast, node->foreach.ident));
+			set_extra(ast, extra + 1, lower(ast, node->foreach.range));
+			data.rhs = lower(ast, node->foreach.stmt);
+			break;
+
+		case EX_FORWHILE:
+		case EX_DOWHILE:
+		case EX_DONTWHILE:
+			data.lhs = lower(ast, node->forwhile.condition);
+			data.rhs = lower(ast, node->forwhile.stmt);
+			break;
+
+		case EX_BLOCK:
+			extra    = RESERVE(ast->extra, node->block.len);
+			data.lhs = extra;
+			data.rhs = node->block.len;
+
+			for_range (c, node->block.len) {
+				set_extra(ast, extra + c, lower(ast, node->block.arr[c]));
+			}
+			break;
+
+		case EX_DECL:
+			extra         = RESERVE(ast->extra, 2);
+			ast->flags[i] = decl_flags(&node->declare);
+			data.lhs      = extra;
+
+			set_extra(ast, extra,     local_symbol(ast, node->declare.name));
+			set_extra(ast, extra + 1, push_type(ast, node->declare.type));
+			data.rhs = lower(ast, node->declare.assign);
+			break;
+
+		case EX_BINOP:
+			ast->flags[i] = node->binop.operator;
+			data.lhs      = lower(ast, node->binop.expra);
+			data.rhs      = lower(ast, node->binop.exprb);
+			break;
+
+		case EX_UNARY:
+			ast->flags[i] = node->unary.operator;
+			data.lhs      = lower(ast, node->unary.expr);
+			break;
+
+		case EX_CALL:
+			extra    = RESERVE(ast->extra, node->call.len + 1);
+			data.lhs = lower(ast, node->call.caller);
+			data.rhs = extra;
+
+			set_extra(ast, extra, node->call.len);
+			for_range (c, node->call.len) {
+				set_extra(ast, extra + 1 + c, lower(ast, node->call.params[c]));
+			}
+			break;
+
+		case EX_SUBMEMBER:
+			data.lhs = lower(ast, node->member.expr);
+			data.rhs = local_symbol(ast, node->member.name);
+			break;
+
+		case EX_FUNCTION:
+			extra    = RESERVE(ast->extra, node->function.args.len + 2);
+			data.rhs = extra;
+
+			set_extra(ast, extra,     push_type(ast, node->function.ret_type));
+			set_extra(ast, extra + 1, node->function.args.len);
+			for_range (c, node->function.args.len) {
+				set_extra(ast, extra + 2 + c, lower(ast, node->function.args.arr[c]));
+			}
+
+			// the body comes after the arguments, like it does in the source
+			data.lhs = lower(ast, node->function.block);
+			break;
+
+		case EX_LITERAL:
+			ast->flags[i] = node->literal.tag;
+
+			switch (node->literal.tag) {
+				case LIT_STR:   data     = push_text(ast, &node->literal.str); break;
+				case LIT_IDENT: data.lhs = local_symbol(ast, node->literal.ident); break;
+				case LIT_BOOL:  data.lhs = node->literal.boolean;              break;
+				case LIT_NUM:   data     = split_u64(node->literal.numi);      break;
+				case LIT_NIL:                                                  break;
+				case LIT_FLT: {
+					u64 bits;
+					memcpy(&bits, &node->literal.numf, sizeof(bits));
+					data = split_u64(bits);
+					break;
+				}
+			}
+			break;
+	}
+
+	ast->data[i] = data;
+	return i;
+}
+
+CompactAst compact_ast(const AstResult *ast) {
+	const u32 cap = ast->pool_size > 0 ? ast->pool_size : 1;
+
+	CompactAst compact = {
+		.tags  = malloc(sizeof(u8)       * cap),
+		.flags = malloc(sizeof(u8)       * cap),
+		.data  = malloc(sizeof(NodeData) * cap),
+		.len   = 0,
+		.cap   = cap,
+
+		.symbol_slots = make(u32, SYMBOL_INIT_SLOTS),
+		.slot_mask    = SYMBOL_INIT_SLOTS - 1,
+	};
+
+	if (!compact.tags || !compact.flags || !compact.data || !compact.symbol_slots) {
+		PANIC("could not allocate compact ast");
+	}
+
+	lower(&compact, ast->pool);
+
+	free(compact.symbol_slots);
+	compact.symbol_slots = NULL;
+	compact.slot_mask    = 0;
+
+	return compact;
+}
+
+size_t compact_ast_size(const CompactAst *ast) {
+	return (sizeof(u8) * 2 + sizeof(NodeData)) * ast->len
+		+ sizeof(u32)    * ast->extra.len
+		+ sizeof(typeid) * ast->types.len
+		+ sizeof(char)   * ast->text.len
+		+ sizeof(Symbol) * ast->symbols.len;
+}
+
+void free_compact_ast(CompactAst *ast) {
+	if (ast->view.data != NULL) {
+		unmap_file(&ast->view);
+	} else {
+		free(ast->tags);
+		free(ast->flags);
+		free(ast->data);
+		free(ast->extra.arr);
+		free(ast->text.arr);
+	}
+
+	free(ast->types.arr);
+	free(ast->symbols.arr);
+	*ast = (CompactAst) {0};
+}
@@ -2,6 +2,9 @@
 
 // force memchecks
 #include "../utils/utils.h"
+#include "../utils/arena.h"
+#include "../utils/intern.h"
+#include "../utils/file.h"
 #include "type.h"
 
 // package management
@@ -11,7 +14,14 @@
 
 #define DOOBLE_INTERNAL
 
-// A parsed token
+// A view into the buffer a token was lexed from. Tokens do not own any memory,
+// so anything that outlives the source buffer needs to make its own copy.
+typedef struct {
+	u32 start; // byte offset into the source buffer
+	u32 len;
+} Span;
+
+// A parsed token, as handed out by next_token
 typedef struct {
 	enum : u8 {
 		// keywords
@@ -43,19 +53,99 @@ typedef struct {
 		DB_EOF = UINT8_MAX,
 	} token;
 
+	u32 offset; // byte offset of the token in the source, see LineTable
+
 	union {
-		string_t str;
+		Span     span;  // DB_STR
+		Symbol   ident; // DB_IDENT
 		intmax_t vali;
 		double   valf;
 	};
-
-	size_t linenum;
 } DoobleToken;
 
-// returns the size of tokens, and fills `tokens` with an array
-u32  get_tokens(cstr buffer, DoobleToken **tokens /* ref to array */);
-void print_tokens(size_t N, DoobleToken tokens[N]);
-void free_tokens(u32 len, DoobleToken tokens[len]);
+// literal payloads, stored out of line in a TokenStream
+typedef union {
+	Span     span; // DB_STR
+	intmax_t vali; // DB_NUM
+	double   valf; // DB_FLOAT
+} TokenValue;
+
+// an opening bracket still waiting for its closer
+typedef struct {
+	u32 index;
+	u32 offset;
+	u8  kind;
+} OpenBracket;
+
+#define NO_MATCH UINT32_MAX
+
+/* Tokens stored as parallel arrays. Kinds are a byte each so peeking only
+ * touches a dense array, and values are kept in a side table that only
+ * literals take space in.
+ * A stream either keeps every token (mask is all ones), or is a ring of the
+ * last `cap` tokens (mask is cap - 1). Indices are absolute in both cases.
+ * Brackets are matched as they are pushed: `match` holds the index of the
+ * other half of a (), [] or {} pair, NO_MATCH for an opener that hasn't been
+ * closed yet or a closer without an opener. */
+typedef struct {
+	u8         *kinds;
+	u32        *offsets;
+	u32        *payload; // the Symbol for DB_IDENT, index into values for other literals
+	u32        *match;   // only meaningful for brackets
+	TokenValue *values;
+	VEC(OpenBracket) open;
+	u32         len;     // tokens pushed so far
+	u32         cap;     // power of 2
+	u32         nvalues; // values pushed so far
+	u32         vcap;    // same as cap for a ring
+	u32         mask;
+	bool        unmatched; // brackets are left for whoever takes the tokens over
+} TokenStream;
+
+TokenStream init_token_stream(u32 cap /* power of 2 */, bool ring);
+void        push_token(TokenStream *ts, const DoobleToken *tok); // a full ring must be grown first
+DoobleToken get_token(const TokenStream *ts, u32 index);
+void        grow_token_stream(TokenStream *ts);
+void        clear_tokens(TokenStream *ts); // empties a stream, keeping its memory
+
+// pull based lexer, tokens are produced one at a time by next_token.
+// DB_STR tokens point back into `buffer`, so it must outlive them.
+typedef struct {
+	const char *buffer;
+	u32         bufsize;
+	u32         pos;
+	u32         start; // where the token being lexed starts
+	u8          last;  // last token handed out, for automatic semicolons
+
+	// identifiers are left as NO_SYMBOL and very long float literals as NaN,
+	// for lexers that run off the main thread. The interner and the memory
+	// checks are not thread safe.
+	bool defer_symbols;
+
+	const LineTable *lines; // only read for diagnostics
+
+	// errors are kept here instead of printed when set, so the ones of
+	// parallel chunks come out in file order (see get_tokens)
+	struct LexDiagnostics_t *diagnostics;
+} Lexer;
+
+Lexer       init_lexer(const char *buffer, u32 len, const LineTable *lines);
+DoobleToken next_token(Lexer *lex); // DB_EOF forever once the buffer is done
+
+// lexes the whole buffer at once, large buffers are split into chunks that
+// are lexed in parallel
+TokenStream get_tokens(cstr buffer);
+void        limit_lex_threads(u32 threads); // for get_tokens, 0 for one per core
+string_t    token_str(cstr buffer, const DoobleToken *token); // owned copy of a span
+void        print_tokens(const TokenStream *ts, cstr buffer);
+void        free_tokens(TokenStream *ts);
+
+// vectorized character class scanning (scan.c). Each returns the index of the
+// first byte at or after `pos` that ends the run, or `len` if there is none.
+u32 skip_blank(const char *buf, u32 pos, u32 len);   // skips ' ' and '\t'
+u32 skip_ident(const char *buf, u32 pos, u32 len);   // skips [a-zA-Z0-9_]
+u32 find_newline(const char *buf, u32 pos, u32 len); // stops on '\n'
+u32 find_quote(const char *buf, u32 pos, u32 len);   // stops on '\'' or '\n'
 
 // ========================================================   
 // ================= Abstract Syntax Tree ================= 
@@ -72,7 +162,7 @@ typedef struct {
 
 typedef struct {
 	bool      by_reference;
-	string_t  ident;
+	Symbol    ident;
 	Node     *range; // ref
 	Node     *stmt;  // ref
 } ForEach;
@@ -87,7 +177,7 @@ typedef VEC(Node *) Block;
 
 // declarations
 typedef struct {
-	string_t  name;
+	Symbol    name;
 	bool      is_const;
 	typeid    type;
 	Node     *assign; // ref
@@ -102,7 +192,6 @@ typedef struct {
 
 // expressions
 
-// TODO: figure out a way to keep the parameter arr in the same arena as everything else
 typedef struct {
 	Node  *caller; // ref
 	Node **params; // arr of ref
@@ -110,8 +199,8 @@ typedef struct {
 } Call;
 
 typedef struct {
-	Node     *expr; // ref
-	string_t  name;
+	Node   *expr; // ref
+	Symbol  name;
 } SubMember;
 
 typedef struct {
@@ -168,6 +257,7 @@ typedef struct {
 
 	union {
 		string_t str;
+		Symbol   ident;
 		bool     boolean;
 		intmax_t numi;
 		double   numf;
@@ -216,21 +306,156 @@ typedef enum {
 	PARSE_ERR = 0b0000000000000001,
 } ParseError;
 
+#define DECL_GONE UINT32_MAX
+
+// a type declaration, anywhere in the file. It makes no node, so its text is
+// part of the top level statement around or after it
+typedef struct {
+	Symbol name;
+	u32    offset; // of the name, DECL_GONE once its statement was edited away
+} TypeDecl;
+
 typedef struct {
-	Node       *pool;
-	size_t      pool_size;
+	Node       *pool;      // the global scope, always the first node
+	size_t      pool_size; // number of nodes in the arena, replaced ones included
 	ParseError  err;
+
+	// where each top level statement ends, just past its separator. The last
+	// one ends with the buffer, so they cover all of it.
+	u32        *bounds;
+
+	// every type the file has put in the type tree, which can't take one out
+	// again. reparse_ast lets the new file declare these once more
+	TypeDecl   *decls;
+	u32         ndecls;
+
+	Arena       arena;     // owns every node, child array and literal string
 } AstResult;
 
+// bytes [start, end) of the old buffer were replaced by `len` new ones
+typedef struct {
+	u32 start;
+	u32 end;
+	u32 len;
+} Edit;
+
 /**
  * Builds an abstract syntax tree
- * (frees the token list after building the tree)
+ * (pulls tokens from the lexer as it goes, only a small window is kept)
  *
- * @param N the length of tokens
- * @param tokens the list of tokens to parse (takes ownership)
- * @param buf the original file the tokens were produced from
+ * @param lexer the lexer over the file to parse
+ * @param tree the type tree that parsed types are added to
  * @return an abstract syntax tree
  * */
-AstResult get_ast(size_t N, DoobleToken tokens[N], TypeTree *tree, const char *const buf);
+AstResult get_ast(Lexer *lexer, TypeTree *tree);
+
+/**
+ * Parses an edited file again, reusing every top level statement that no edit
+ * touched. Runs of touched statements are parsed on their own, if one of them
+ * doesn't stand on its own (an unclosed bracket that swallows the statements
+ * after it) the whole file is parsed instead.
+ *
+ * Types the old file declared are already in the tree. The new file may
+ * declare each of them once more, anywhere, but only as the same type: the
+ * tree can't rebind a name, so a file whose types changed has to be parsed
+ * into a new tree.
+ *
+ * @param old the result for the file before the edits, it is consumed
+ * @param lexer the lexer over the edited file
+ * @param tree the type tree that parsed types are added to
+ * @param edits sorted and not overlapping, in offsets of the old buffer
+ * @return an abstract syntax tree for the edited file
+ * */
+AstResult reparse_ast(AstResult *old, Lexer *lexer, TypeTree *tree, const Edit *edits, u32 count);
 void      print_ast(Node *node);
-void      free_ast(size_t N, Node pool[N]);
+void      free_ast(AstResult *ast);
+
+// lexer and parser throughput (bench.c), only built with the bench flag.
+// returns the number of regressions against the saved baseline
+int dooble_bench(int argc, char **argv);
+
+/* Compact encoding of an AST, built from the pointer tree by compact_ast.
+ *
+ * Nodes are parallel arrays that refer to each other by u32 index instead of
+ * by pointer. They are laid out in pre order, so a parent always comes before
+ * its children and a walk over the tree only ever moves forward through
+ * memory. Index 0 is the root, which is never anyone's child, so 0 doubles as
+ * NO_NODE. Anything that doesn't fit in lhs/rhs, including child lists, lives
+ * in `extra`.
+ *
+ * tag           flags       lhs                  rhs
+ * EX_PASS       -           -                    -
+ * EX_IF         -           condition            extra: stmt, else
+ * EX_*EACH      by ref      extra: ident, range  stmt
+ * EX_*WHILE     -           condition            stmt
+ * EX_BLOCK      -           extra: stmts...      len
+ * EX_DECL       DeclFlags   extra: name, type    assign
+ * EX_BINOP      operator    expra                exprb
+ * EX_UNARY      operator    expr                 -
+ * EX_CALL       -           caller               extra: len, params...
+ * EX_SUBMEMBER  -           expr                 name
+ * EX_FUNCTION   -           block                extra: type, len, args...
+ * EX_LITERAL    LIT_*       see below
+ *
+ * Literals keep their value in lhs/rhs: strings are an offset and length into
+ * `text`, identifiers and booleans sit in lhs, numbers are split into the low
+ * (lhs) and high (rhs) 32 bits. Types are indices into `types`, and every name
+ * is an index into `symbols` instead of a Symbol, so nothing in the node arrays
+ * depends on the process that built them (see the AST cache). */
+typedef u32 NodeIndex;
+#define NO_NODE 0
+
+typedef enum : u8 {
+	DECL_CONST   = 1 << 0,
+	DECL_STATIC  = 1 << 1,
+	DECL_PUB     = 1 << 2,
+	DECL_CO      = 1 << 3,
+	DECL_PROTECT = 1 << 4,
+	DECL_FINAL   = 1 << 5,
+} DeclFlags;
+
+typedef struct {
+	u32 lhs;
+	u32 rhs;
+} NodeData;
+
+typedef struct {
+	u8       *tags;
+	u8       *flags;
+	NodeData *data;
+	u32       len;
+	u32       cap;
+
+	VEC(u32)    extra;
+	VEC(typeid) types;
+	VEC(char)   text;
+	VEC(Symbol) symbols;
+
+	// Symbol -> index + 1 into symbols, only while compact_ast runs
+	u32 *symbol_slots;
+	u32  slot_mask;
+
+	// a loaded ast's node, extra and text arrays point into the cache file
+	FileView view;
+} CompactAst;
+
+CompactAst compact_ast(const AstResult *ast);
+size_t     compact_ast_size(const CompactAst *ast); // bytes, for comparing against the pointer tree
+void       print_compact_ast(const CompactAst *ast, NodeIndex node);
+void       free_compact_ast(CompactAst *ast);
+
+static inline Symbol compact_symbol(const CompactAst *ast, u32 index) {
+	return ast->symbols.arr[index];
+}
+
+/* Binary AST cache (cache.c)
+ *
+ * A CompactAst saved to `dir` in a file named after the hash of the source it
+ * was parsed from, so an unchanged file skips lexing and parsing: loading maps
+ * the file and uses the node arrays in place. Only the symbol and type tables
+ * are rebuilt, types are added to `tree` as needed and only on a hit. The
+ * directory has to exist. */
+u64  source_hash(const char *buffer, u32 len);
+bool ast_cache_path(char *out, size_t size, cstr dir, u64 hash); // false if it doesn't fit
+bool save_ast_cache(cstr dir, const char *source, u32 len, const TypeTree *tree, const CompactAst *ast);
+bool load_ast_cache(cstr dir, const char *source, u32 len, TypeTree *tree, CompactAst *out); // false on a miss
@@ -1,10 +1,21 @@
 #include "internal.h"
+#include "../utils/decimal.h"
 #include "../utils/utils.h"
-#include "../utils/hash.h"
-#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <unistd.h>
+#endif
 
-#define KEYWORDS_LEN 37
 static const char *const KEYWORDS[] = {
 	[DB_ALLOC]    = "alloc",
 	[DB_ALIAS]    = "alias",
@@ -46,21 +57,81 @@ static const char *const KEYWORDS[] = {
 	[DB_YIELD]    = "yield",
 };
 
-static HashSet KEYWORD_SET;
+/* Keywords are found with a perfect hash over the first character, the last
+ * character, and the length of the word. Every keyword gets its own slot, so a
+ * lookup is one table read and one compare against KEYWORDS.
+ *
+ * If a keyword gets added, the constants in KEYWORD_HASH may need to change.
+ * keyword_test checks that no two keywords share a slot. */
+#define KEYWORD_HASH(first, last, len) (((first) + (last) * 7 + (len) * 20) & 127)
+#define KEYWORD(tok, first, last, len) [KEYWORD_HASH(first, last, len)] = tok + 1
+#define KEYWORD_MAX_LEN 8
+
+// maps a KEYWORD_HASH to its token + 1, so that 0 is an empty slot
+static const u8 KEYWORD_TABLE[128] = {
+	KEYWORD(DB_ALLOC,    'a', 'c', 5),
+	KEYWORD(DB_ALIAS,    'a', 's', 5),
+	KEYWORD(DB_AND,      'a', 'd', 3),
+	KEYWORD(DB_BREAK,    'b', 'k', 5),
+	KEYWORD(DB_CASE,     'c', 'e', 4),
+	KEYWORD(DB_CO,       'c', 'o', 2),
+	KEYWORD(DB_CONTINUE, 'c', 'e', 8),
+	KEYWORD(DB_DEFER,    'd', 'r', 5),
+	KEYWORD(DB_DO,       'd', 'o', 2),
+	KEYWORD(DB_DONT,     'd', 't', 5),
+	KEYWORD(DB_ELSE,     'e', 'e', 4),
+	KEYWORD(DB_ELIF,     'e', 'f', 4),
+	KEYWORD(DB_FALL,     'f', 'l', 4),
+	KEYWORD(DB_FALSE,    'f', 'e', 5),
+	KEYWORD(DB_FINAL,    'f', 'l', 5),
+	KEYWORD(DB_FOR,      'f', 'r', 3),
+	KEYWORD(DB_FREE,     'f', 'e', 4),
+	KEYWORD(DB_IF,       'i', 'f', 2),
+	KEYWORD(DB_IN,       'i', 'n', 2),
+	KEYWORD(DB_IS,       'i', 's', 2),
+	KEYWORD(DB_INCLUDE,  'i', 'e', 7),
+	KEYWORD(DB_MAP,      'm', 'p', 3),
+	KEYWORD(DB_MATCH,    'm', 'h', 5),
+	KEYWORD(DB_NIL,      'n', 'l', 3),
+	KEYWORD(DB_NOT,      'n', 't', 3),
+	KEYWORD(DB_OR,       'o', 'r', 2),
+	KEYWORD(DB_PACKAGE,  'p', 'e', 7),
+	KEYWORD(DB_PROTOCOL, 'p', 'l', 8),
+	KEYWORD(DB_PROTECT,  'p', 't', 7),
+	KEYWORD(DB_PUB,      'p', 'b', 3),
+	KEYWORD(DB_RETURN,   'r', 'n', 6),
+	KEYWORD(DB_STATIC,   's', 'c', 6),
+	KEYWORD(DB_STRUCT,   's', 't', 6),
+	KEYWORD(DB_SUMTYPE,  's', 'e', 7),
+	KEYWORD(DB_TEST,     't', 't', 4),
+	KEYWORD(DB_TRUE,     't', 'e', 4),
+	KEYWORD(DB_VEC,      'v', 'c', 3),
+	KEYWORD(DB_YIELD,    'y', 'd', 5),
+};
 
-typedef struct {
-	const char *buffer;
-	size_t      bufsize;
-	u32         pos;
-	u32         line;
-	u32         line_start;
+// returns the keyword token for a word, or DB_IDENT if it is not a keyword
+static u8 keyword_token(const char *word, u32 len) {
+	if (len < 2 || len > KEYWORD_MAX_LEN) return DB_IDENT;
 
-	struct {
-		DoobleToken *arr;
-		u32          cap;
-		u32          len;
-	} tokens;
-} Lexer;
+	const u8 slot = KEYWORD_TABLE[KEYWORD_HASH((u8) word[0], (u8) word[len - 1], len)];
+	if (slot == 0) return DB_IDENT;
+
+	const char *keyword = KEYWORDS[slot - 1];
+	if (strncmp(keyword, word, len) != 0 || keyword[len] != '\0') {
+		return DB_IDENT;
+	}
+
+	return slot - 1;
+}
+
+// ascii only, the ctype.h versions depend on the locale
+static bool is_alpha(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+static bool is_alnum(char ch) {
+	return is_alpha(ch) || (ch >= '0' && ch <= '9');
+}
 
 static char advance(Lexer *l) {
 	if (l->pos >= l->bufsize)
@@ -83,25 +154,14 @@ static bool match(Lexer *l, char ch) {
 	return false;
 }
 
-static void append_token(Lexer *l, u8 toknum) {
-	if (l->tokens.len >= l->tokens.cap) {
-		l->tokens.cap *= 2;
-		let tmp = realloc(l->tokens.arr, l->tokens.cap);
+// every token handed out goes through here, auto_semicolon looks at the last one
+static DoobleToken make_token(Lexer *l, u8 toknum) {
+	l->last = toknum;
 
-		if (tmp == NULL) {
-			free(tmp);
-			PANIC("could not extend tokens");
-		}
-
-		l->tokens.arr = tmp;
-	}
-
-	let tok = (DoobleToken) {
+	return (DoobleToken) {
 		.token   = toknum,
-		.linenum = l->line,
+		.offset  = l->start,
 	};
-
-	l->tokens.arr[l->tokens.len++] = tok;
 }
 
 /* This should allow for the preservation of some syntax items:
@@ -114,297 +174,810 @@ static void append_token(Lexer *l, u8 toknum) {
  * item := map[str,int] {
  * } +;
  * */
-static void auto_semicolon(Lexer *l) {
-	if (l->tokens.len == 0) return;
-
-	let tok = l->tokens.arr[l->tokens.len - 1].token;
-	if (tok != DB_DOT &&
-		tok != DB_COMMA &&
-		tok != DB_LBRACE &&
-		tok != DB_LPAREN &&
-		tok != DB_LSQUARE &&
-		tok != DB_SEMI)
-	{
-		append_token(l, DB_SEMI);
+static bool auto_semicolon(Lexer *l) {
+	return l->last != DB_DOT &&
+		l->last != DB_COMMA &&
+		l->last != DB_LBRACE &&
+		l->last != DB_LPAREN &&
+		l->last != DB_LSQUARE &&
+		l->last != DB_SEMI;
+}
+
+#define LEX_DIAG_MAX 16 // per chunk, the ones after it are only counted
+#define LEX_DIAG_LEN 96
+
+// errors of a chunk lexed off the main thread. Fixed size, workers don't allocate
+typedef struct LexDiagnostics_t {
+	struct {
+		u32  offset;
+		char text[LEX_DIAG_LEN];
+	} arr[LEX_DIAG_MAX];
+
+	u32 len;
+	u32 dropped;
+} LexDiagnostics;
+
+static void lex_error(Lexer *l, u32 offset, cstr format, ...) {
+	char    text[LEX_DIAG_LEN];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	LexDiagnostics *diags = l->diagnostics;
+	if (diags == NULL) {
+		error_at("%s", l->lines, offset, text);
+	} else if (diags->len < LEX_DIAG_MAX) {
+		diags->arr[diags->len].offset = offset;
+		memcpy(diags->arr[diags->len++].text, text, sizeof(text));
+	} else {
+		diags->dropped++;
 	}
 }
 
-static void lex_string(Lexer *l) {
-	bool     is_valid = true;
-	string_t str      = init_str("");
+static void print_diagnostics(const LexDiagnostics *diags, const LineTable *lines) {
+	for_range (i, diags->len) error_at("%s", lines, diags->arr[i].offset, diags->arr[i].text);
 
-	while (l->pos < l->bufsize && peek(l, 0) != '\'') {
-		if (peek(l, 0) == '\n') {
-			error_file("string cannot contain new lines", l->line, l->buffer);
-			l->line++;
-			l->line_start = l->pos;
-			is_valid      = false;
-		}
+	if (diags->dropped > 0) error("%u more errors in this part of the file", diags->dropped);
+}
+
+static DoobleToken lex_string(Lexer *l) {
+	bool is_valid = true;
+	Span str      = { .start = l->pos, .len = 0 };
 
-		if (is_valid) addchar(&str, advance(l));
+	loop {
+		l->pos = find_quote(l->buffer, l->pos, l->bufsize);
+		if (is_valid) str.len = l->pos - str.start;
+
+		if (peek(l, 0) != '\n') break;
+
+		lex_error(l, l->pos, "string cannot contain new lines");
+		is_valid = false;
+		advance(l);
 	}
 
 	if (l->pos >= l->bufsize) {
-		error_file("string must end with a '", l->line, l->buffer);
+		lex_error(l, l->start, "string must end with a '");
 	} else {
 		advance(l); // consume '
 	}
 
-	append_token(l, DB_STR);
-	l->tokens.arr[l->tokens.len - 1].str = str;
+	let tok  = make_token(l, DB_STR);
+	tok.span = str;
+	return tok;
 }
 
-static void lex_identifier(Lexer *l) {
+static DoobleToken lex_identifier(Lexer *l) {
 	l->pos -= 1; // backtrack
 
-	string_t ident = init_str("");
+	Span ident = { .start = l->pos, .len = 0 };
 
-	while (l->pos < l->bufsize) {
-		char ch = peek(l, 0);
+	l->pos    = skip_ident(l->buffer, l->pos, l->bufsize);
+	ident.len = l->pos - ident.start;
 
-		if (isalnum(ch) || ch == '_') {
-			addchar(&ident, advance(l));
-		}
-		else break;
+	// don't is the only keyword that is not a plain identifier
+	if (ident.len == 3
+			&& peek(l, 0) == '\''
+			&& peek(l, 1) == 't'
+			&& !is_alnum(peek(l, 2)) && peek(l, 2) != '_'
+			&& strncmp(&l->buffer[ident.start], "don", 3) == 0)
+	{
+		l->pos += 2;
+		return make_token(l, DB_DONT);
+	}
+
+	const u8 keyword = keyword_token(&l->buffer[ident.start], ident.len);
+	if (keyword != DB_IDENT) {
+		return make_token(l, keyword);
+	}
+
+	let tok   = make_token(l, DB_IDENT);
+	tok.ident = l->defer_symbols
+		? NO_SYMBOL
+		: intern(&l->buffer[ident.start], ident.len);
+	return tok;
+}
+
+// value of a digit in any base up to 16, 16 if ch is not a digit at all
+static u8 digit_value(char ch) {
+	switch (ch) {
+		case '0' ... '9': return ch - '0';
+		case 'a' ... 'f': return ch - 'a' + 10;
+		case 'A' ... 'F': return ch - 'A' + 10;
+		default:          return 16;
 	}
+}
 
-	if (has_item(&KEYWORD_SET, ident.str)) {
-		append_token(l, get_item(&KEYWORD_SET, ident.str));
-		freestr(&ident);
+// a decimal literal is worth mantissa * 10^exp10. Only the first 19
+// significant digits fit in the mantissa, the rest only move the exponent.
+typedef struct {
+	u64  mantissa;
+	i32  exp10;
+	u8   digits;    // significant digits in mantissa
+	bool truncated; // a non zero digit was dropped
+} Decimal;
+
+static void add_digit(Decimal *dec, u8 digit, bool fraction) {
+	if (dec->digits == 0 && digit == 0) {
+		dec->exp10 -= fraction; // leading zeros only matter after the point
 		return;
 	}
 
-	append_token(l, DB_IDENT);
-	l->tokens.arr[l->tokens.len - 1].str = ident;
+	if (dec->digits < 19) {
+		dec->mantissa = dec->mantissa * 10 + digit;
+		dec->exp10   -= fraction;
+		dec->digits++;
+		return;
+	}
+
+	dec->exp10     += !fraction;
+	dec->truncated |= digit != 0;
+}
+
+// strtod on the literal without its separators, for the few inputs
+// decimal_to_double can't round on its own. A lexer off the main thread
+// doesn't allocate, a literal too long for the stack is NaN until
+// append_chunk lexes it again
+static double slow_float(Lexer *l) {
+	char      stack[128];
+	const u32 len = l->pos - l->start;
+	u32       n   = 0;
+
+	if (len >= sizeof(stack) && l->defer_symbols) return NAN;
+
+	char *text = len < sizeof(stack) ? stack : malloc(len + 1);
+	if (text == NULL) PANIC("could not allocate float literal");
+
+	for (u32 i = l->start; i < l->pos; i++) {
+		if (l->buffer[i] != '_') text[n++] = l->buffer[i];
+	}
+	text[n] = '\0';
+
+	const double value = strtod(text, NULL);
+	if (text != stack) free(text);
+
+	return value;
+}
+
+static double float_value(Lexer *l, const Decimal *dec) {
+	double value, upper;
+
+	if (decimal_to_double(dec->mantissa, dec->exp10, &value)) {
+		if (!dec->truncated) return value;
+
+		// the dropped digits put the real value somewhere below mantissa + 1
+		if (decimal_to_double(dec->mantissa + 1, dec->exp10, &upper) && value == upper) {
+			return value;
+		}
+	}
+
+	return slow_float(l);
 }
 
 // handle differently formatted numbers:
 // - 0xFF0fd (hex with multiple caps)
 // - 0o12722 (oct)
 // - 0b01011 (binary)
-// - 123456f (floating point)
 // - 123.456 (floating point)
 // - 123_456 (int with seperators)
-static void lex_number(Lexer *l) {
-	enum {
-		NUM_UNDECIDED,
-		NUM_BIN,
-		NUM_OCT,
-		NUM_HEX,
-		NUM_FLOAT,
-	} numfmt = NUM_UNDECIDED;
+//
+// Digits are accumulated straight from the buffer. Decimal integers have to
+// fit in an intmax_t, the other bases may use all 64 bits.
+// returns false if the number was invalid, no token is produced then
+static bool lex_number(Lexer *l, DoobleToken *tok) {
+	static const char *const BASE_NAME[] = { [2] = "binary", [8] = "octal", [16] = "hex" };
 
 	l->pos--; // get first digit
-	string_t numstr = init_str("");
-	char     ch     = 0;
-
-	for (int i = 0; (ch = advance(l)) != 0; i++) {
-		if (i == 1 && numstr.str[0] == '0') {
-			if (ch == 'b') numfmt = NUM_BIN;
-			if (ch == 'o') numfmt = NUM_OCT;
-			if (ch == 'x') numfmt = NUM_HEX;
-		}
 
-		else if (numfmt == NUM_UNDECIDED && ch == '.') {
-			numfmt = NUM_FLOAT;
-			addchar(&numstr, ch);
-		} else if (ch == '.') {
-			error_file("number has invalid decimal", l->line, l->buffer);
-			goto invalid;
+	u8 base = 10;
+	if (peek(l, 0) == '0') {
+		switch (peek(l, 1)) {
+			case 'b': base = 2;  break;
+			case 'o': base = 8;  break;
+			case 'x': base = 16; break;
 		}
 
-		else if (ch == '_') continue;
+		if (base != 10) l->pos += 2;
+	}
 
-		else if (numfmt == NUM_BIN && ch != '0' && ch != '1' && isalnum(ch)) {
-			error_file("invalid digit '%c' in binary literal",
-					l->line, l->buffer, ch);
-			goto invalid;
-		}
+	Decimal dec      = {0};
+	u64     value    = 0;
+	bool    is_float = false;
+	bool    overflow = false;
 
-		else if (numfmt == NUM_OCT && (ch < '0' || ch > '7')) {
-			error_file("invalid digit '%c' in octal literal",
-					l->line, l->buffer, ch);
-			goto invalid;
-		}
+	for (char ch; (ch = peek(l, 0)) != 0; l->pos++) {
+		if (ch == '_') continue;
 
-		else if (numfmt == NUM_HEX && isalnum(ch)) {
-			switch (ch) {
-				case '0' ... '9':
-				case 'a' ... 'f':
-				case 'A' ... 'F':
-					addchar(&numstr, ch);
-					break;
+		if (ch == '.') {
+			if (peek(l, 1) == '.') break; // a range, '1..5'
 
-				default:
-					error_file("invalid digit '%c' in hex literal",
-							l->line, l->buffer, ch);
-					goto invalid;
+			if (base != 10 || is_float) {
+				lex_error(l, l->pos, "number has invalid decimal");
+				goto invalid;
 			}
+
+			is_float = true;
+			continue;
 		}
 
-		else if (ch >= '0' && ch <= '9') {
-			addchar(&numstr, ch);
+		const u8 digit = digit_value(ch);
+		if (digit >= base) {
+			if (base == 10 || !is_alnum(ch)) break;
+
+			lex_error(l, l->pos, "invalid digit '%c' in %s literal", ch, BASE_NAME[base]);
+			goto invalid;
 		}
 
-		else {
-			l->pos--; // backtrace
-			break;
+		if (base == 10) {
+			add_digit(&dec, digit, is_float);
+		} else {
+			const u8 shift = base == 2 ? 1 : base == 8 ? 3 : 4;
+
+			overflow |= (value >> (64 - shift)) != 0;
+			value     = value << shift | digit;
 		}
 	}
 
-	double    numf = 0;
-	long long numi = 0;
+	if (is_float) {
+		*tok      = make_token(l, DB_FLOAT);
+		tok->valf = float_value(l, &dec);
+		return true;
+	}
 
-	switch (numfmt) {
-		case NUM_FLOAT:
-			numf = atof(numstr.str);
-			append_token(l, DB_FLOAT);
-			l->tokens.arr[l->tokens.len - 1].valf = numf;
-			break;
-		case NUM_UNDECIDED:
-			numi = strtoll(numstr.str, NULL, 10);
-			break;
-		case NUM_BIN:
-			numi = strtoll(numstr.str, NULL, 2);
-			break;
-		case NUM_OCT:
-			numi = strtoll(numstr.str, NULL, 8);
-			break;
-		case NUM_HEX:
-			numi = strtoll(numstr.str, NULL, 16);
-			break;
+	if (base == 10) {
+		overflow = dec.truncated || dec.exp10 != 0 || dec.mantissa > INTMAX_MAX;
+		value    = dec.mantissa;
 	}
 
-	if (numfmt != NUM_FLOAT) {
-		append_token(l, DB_NUM);
-		l->tokens.arr[l->tokens.len - 1].vali = numi;
+	if (overflow) {
+		lex_error(l, l->start, "integer literal is too large");
+		return false;
 	}
 
-	freestr(&numstr);
-	return;
+	*tok      = make_token(l, DB_NUM);
+	tok->vali = (intmax_t) value;
+	return true;
 
 invalid:
-	// unwind
-	do ch = advance(l); while (!isalnum(ch) && ch != '_');
-	freestr(&numstr);
+	// skip the rest of the literal so it doesn't turn into more tokens
+	l->pos = skip_ident(l->buffer, l->pos + 1, l->bufsize);
+	return false;
 }
 
-#define INIT_TOKENS_LEN 30
-u32 get_tokens(cstr buffer, DoobleToken **tokens) {
-	Lexer lex = {
+Lexer init_lexer(const char *buffer, u32 len, const LineTable *lines) {
+	return (Lexer) {
 		.buffer     = buffer,
-		.bufsize    = strlen(buffer),
+		.bufsize    = len,
 		.pos        = 0,
-		.line       = 0,
-		.line_start = 0,
-
-		.tokens = {
-			.arr = malloc(sizeof(DoobleToken) * INIT_TOKENS_LEN),
-			.cap = INIT_TOKENS_LEN,
-			.len = 0,
-		},
+		.start      = 0,
+		.last       = DB_SEMI, // no semicolon before the first token
+		.lines      = lines,
 	};
+}
+
+DoobleToken next_token(Lexer *lex) {
+	while (lex->pos < lex->bufsize) {
+		DoobleToken tok;
+		char        ch;
 
-	for_range (i, lex.bufsize) {
-		char ch;
-		switch (ch = advance(&lex)) {
+		lex->start = lex->pos;
+		switch (ch = advance(lex)) {
 			case '\n':
-				if (peek(&lex, 0) != '\n') {
-					auto_semicolon(&lex);
+				if (peek(lex, 0) != '\n' && auto_semicolon(lex)) {
+					lex->pos--; // the newline gets handled again on the next call
+					return make_token(lex, DB_SEMI);
 				}
 
-				lex.line++;
-				lex.line_start = lex.pos;
+				fallthrough;
+			case '\r': // sources are lexed as is, CRLF included
 				fallthrough;
 			case '\t':
 				fallthrough;
 			case ' ':
+				lex->pos = skip_blank(lex->buffer, lex->pos, lex->bufsize);
 				break;
 
-			case '&': append_token(&lex, DB_AMPER);   break;
-			case '|': append_token(&lex, DB_BITOR);   break;
-			case '~': append_token(&lex, DB_BITNOT);  break;
-			case '=': append_token(&lex, DB_EQUAL);   break;
-			case ':': append_token(&lex, DB_COLON);   break;
-			case '{': append_token(&lex, DB_LBRACE);  break;
-			case '}': append_token(&lex, DB_RBRACE);  break;
-			case '[': append_token(&lex, DB_LSQUARE); break;
-			case ']': append_token(&lex, DB_RSQUARE); break;
-			case '(': append_token(&lex, DB_LPAREN);  break;
-			case ')': append_token(&lex, DB_RPAREN);  break;
-			case '*': append_token(&lex, DB_STAR);    break;
-			case '+': append_token(&lex, DB_PLUS);    break;
-			case '/': append_token(&lex, DB_SLASH);   break;
-			case '?': append_token(&lex, DB_QUEST);   break;
-			case ',': append_token(&lex, DB_COMMA);   break;
-			case ';': append_token(&lex, DB_SEMI);    break;
+			case '&': return make_token(lex, DB_AMPER);
+			case '|': return make_token(lex, DB_BITOR);
+			case '~': return make_token(lex, DB_BITNOT);
+			case '=': return make_token(lex, DB_EQUAL);
+			case ':': return make_token(lex, DB_COLON);
+			case '{': return make_token(lex, DB_LBRACE);
+			case '}': return make_token(lex, DB_RBRACE);
+			case '[': return make_token(lex, DB_LSQUARE);
+			case ']': return make_token(lex, DB_RSQUARE);
+			case '(': return make_token(lex, DB_LPAREN);
+			case ')': return make_token(lex, DB_RPAREN);
+			case '*': return make_token(lex, DB_STAR);
+			case '+': return make_token(lex, DB_PLUS);
+			case '/': return make_token(lex, DB_SLASH);
+			case '?': return make_token(lex, DB_QUEST);
+			case ',': return make_token(lex, DB_COMMA);
+			case ';': return make_token(lex, DB_SEMI);
 
 			case '<':
-				append_token(&lex, match(&lex, '=') ? DB_LESSEQ : DB_LESS);
-				break;
+				return make_token(lex, match(lex, '=') ? DB_LESSEQ : DB_LESS);
 			case '>':
-				append_token(&lex, match(&lex, '=') ? DB_GREATEREQ : DB_GREATER);
-				break;
+				return make_token(lex, match(lex, '=') ? DB_GREATEREQ : DB_GREATER);
 
 			case '.':
-				if (match(&lex, '.')) {
-					append_token(&lex, match(&lex, '.') ? DB_DOTDOTDOT : DB_DOTDOT);
+				if (match(lex, '.')) {
+					return make_token(lex, match(lex, '.') ? DB_DOTDOTDOT : DB_DOTDOT);
 				}
 
-				append_token(&lex, DB_DOT);
-				break;
+				return make_token(lex, DB_DOT);
 
 			case '-':
-				if (match(&lex, '-')) {
-					while (lex.pos < lex.bufsize && peek(&lex, 0) != '\n')
-						advance(&lex);
+				if (match(lex, '-')) {
+					lex->pos = find_newline(lex->buffer, lex->pos, lex->bufsize);
+					break;
 				}
 
-				else if (match(&lex, '>')) append_token(&lex, DB_ARROW);
-				else                       append_token(&lex, DB_MINUS);
-				break;
+				return make_token(lex, match(lex, '>') ? DB_ARROW : DB_MINUS);
 
 			case '\'':
-				lex_string(&lex);
-				break;
+				return lex_string(lex);
 
 			default:
-				if (isalpha(ch)) {
-					lex_identifier(&lex);
+				if (is_alpha(ch)) {
+					return lex_identifier(lex);
 				}
 
 				// apparently isnum isn't a function?
 				else if(ch >= '0' && ch <= '9') {
-					lex_number(&lex);
+					if (lex_number(lex, &tok)) return tok;
 				}
 				break;
 		}
 	}
 
-	append_token(&lex, DB_EOF);
+	return make_token(lex, DB_EOF);
+}
+
+// ===================
+// === TOKEN STREAM ===
+// ===================
+
+#define INIT_BRACKETS_LEN 16
+
+static bool has_value(u8 kind) {
+	return kind == DB_NUM || kind == DB_FLOAT || kind == DB_STR;
+}
+
+TokenStream init_token_stream(u32 cap, bool ring) {
+	TokenStream ts = {
+		.kinds   = malloc(sizeof(u8)  * cap),
+		.offsets = malloc(sizeof(u32) * cap),
+		.payload = malloc(sizeof(u32) * cap),
+		.match   = malloc(sizeof(u32) * cap),
+		.values  = malloc(sizeof(TokenValue) * cap),
+		.len     = 0,
+		.cap     = cap,
+		.nvalues = 0,
+		.vcap    = cap,
+		.mask    = ring ? cap - 1 : UINT32_MAX,
+	};
 
-	*tokens = lex.tokens.arr;
-	return lex.tokens.len;
+	if (!ts.kinds || !ts.offsets || !ts.payload || !ts.match || !ts.values) {
+		PANIC("could not allocate token stream");
+	}
+
+	return ts;
 }
 
-void print_tokens(size_t N, DoobleToken tokens[N]) {
-	for_range (i, N) {
-		logger("Tok%0d ", tokens[i].token);
+#define RESIZE(arr, size) do {                            \
+		let tmp = realloc(arr, sizeof(*(arr)) * (size));  \
+		if (tmp == NULL) PANIC("could not extend tokens"); \
+		arr = tmp;                                        \
+	} while (0)
+
+// moves a ring's live entries to where the bigger mask expects them
+#define RELAYOUT(arr, count, old_mask, new_mask) do {                \
+		typeof(arr) tmp = malloc(sizeof(*(arr)) * ((new_mask) + 1)); \
+		if (tmp == NULL) PANIC("could not extend tokens");           \
+		const u32 first = (count) > (old_mask) + 1                   \
+			? (count) - (old_mask) - 1                               \
+			: 0;                                                     \
+		for (u32 i = first; i < (count); i++) {                      \
+			tmp[i & (new_mask)] = (arr)[i & (old_mask)];             \
+		}                                                            \
+		free(arr);                                                   \
+		arr = tmp;                                                   \
+	} while (0)
+
+void grow_token_stream(TokenStream *ts) {
+	const u32 cap = ts->cap * 2;
+
+	if (ts->mask == UINT32_MAX) {
+		RESIZE(ts->kinds,   cap);
+		RESIZE(ts->offsets, cap);
+		RESIZE(ts->payload, cap);
+		RESIZE(ts->match,   cap);
+		ts->cap = cap;
+		return;
+	}
 
-		switch (tokens[i].token) {
+	// values line up with tokens in a ring, so both grow together
+	const u32 mask = cap - 1;
+	RELAYOUT(ts->kinds,   ts->len,     ts->mask, mask);
+	RELAYOUT(ts->offsets, ts->len,     ts->mask, mask);
+	RELAYOUT(ts->payload, ts->len,     ts->mask, mask);
+	RELAYOUT(ts->match,   ts->len,     ts->mask, mask);
+	RELAYOUT(ts->values,  ts->nvalues, ts->mask, mask);
+
+	ts->cap  = cap;
+	ts->vcap = cap;
+	ts->mask = mask;
+}
+
+// pairs the bracket at `index` with the innermost open one, see TokenStream
+static void match_bracket(TokenStream *ts, u32 index) {
+	const u32 i    = index & ts->mask;
+	const u8  kind = ts->kinds[i];
+
+	switch (kind) {
+		case DB_LPAREN:
+		case DB_LSQUARE:
+		case DB_LBRACE:
+			if (ts->open.len >= ts->open.cap) {
+				ts->open.cap = ts->open.cap ? ts->open.cap * 2 : INIT_BRACKETS_LEN;
+				RESIZE(ts->open.arr, ts->open.cap);
+			}
+
+			ts->match[i] = NO_MATCH;
+			ts->open.arr[ts->open.len++] = (OpenBracket) {
+				.index  = index,
+				.offset = ts->offsets[i],
+				.kind   = kind,
+			};
+			return;
+
+		case DB_RPAREN:
+		case DB_RSQUARE:
+		case DB_RBRACE:
+			ts->match[i] = NO_MATCH;
+
+			// closers come right after their openers in the token enum. One that
+			// doesn't close the innermost bracket is left unmatched, and the
+			// opener keeps waiting
+			if (ts->open.len == 0 || ts->open.arr[ts->open.len - 1].kind + 1 != kind) {
+				return;
+			}
+
+			const u32 open = ts->open.arr[--ts->open.len].index;
+			ts->match[i] = open;
+
+			// the opener might have left a ring already
+			if (ts->len - open <= ts->cap) ts->match[open & ts->mask] = index;
+			return;
+
+		default:
+			return;
+	}
+}
+
+void clear_tokens(TokenStream *ts) {
+	ts->len      = 0;
+	ts->nvalues  = 0;
+	ts->open.len = 0;
+}
+
+void push_token(TokenStream *ts, const DoobleToken *tok) {
+	if (ts->mask == UINT32_MAX) {
+		if (ts->len >= ts->cap) grow_token_stream(ts);
+
+		if (has_value(tok->token) && ts->nvalues >= ts->vcap) {
+			ts->vcap *= 2;
+			RESIZE(ts->values, ts->vcap);
+		}
+	}
+
+	const u32 i = ts->len++ & ts->mask;
+
+	ts->kinds[i]   = tok->token;
+	ts->offsets[i] = tok->offset;
+	ts->payload[i] = tok->token == DB_IDENT ? tok->ident : 0;
+
+	if (has_value(tok->token)) {
+		ts->payload[i] = ts->nvalues;
+
+		let value = &ts->values[ts->nvalues++ & ts->mask];
+		switch (tok->token) {
+			case DB_NUM:   value->vali = tok->vali; break;
+			case DB_FLOAT: value->valf = tok->valf; break;
+			case DB_STR:   value->span = tok->span; break;
+			default:                                break;
+		}
+	}
+
+	if (!ts->unmatched) match_bracket(ts, ts->len - 1);
+}
+
+DoobleToken get_token(const TokenStream *ts, u32 index) {
+	const u32 i = index & ts->mask;
+
+	DoobleToken tok = {
+		.token   = ts->kinds[i],
+		.offset  = ts->offsets[i],
+	};
+
+	const TokenValue *value = &ts->values[ts->payload[i] & ts->mask];
+	switch (tok.token) {
+		case DB_IDENT: tok.ident = ts->payload[i]; break;
+		case DB_NUM:   tok.vali  = value->vali;    break;
+		case DB_FLOAT: tok.valf  = value->valf;    break;
+		case DB_STR:   tok.span  = value->span;    break;
+		default:                                   break;
+	}
+
+	return tok;
+}
+
+// ========================
+// === PARALLEL LEXING ===
+// ========================
+
+/* Strings and comments can't span lines, so lexing can resume at any line
+ * start. Big buffers are cut into chunks that each end on a newline, and every
+ * chunk gets its own lexer over the same buffer, so token offsets (and with
+ * them lines from the LineTable) are already absolute.
+ *
+ * A chunk lexer starts as if a semicolon came right before it, which means
+ * newlines before its first token never insert one. That is what a lexer over
+ * the whole buffer does too: the newline ending the previous chunk already
+ * settled the semicolon for the last token before it. Cuts are never made
+ * inside a run of newlines, so that newline sees the same next character
+ * either way.
+ *
+ * The memory checks and the interner are not thread safe, so workers only
+ * fill streams allocated up front and leave identifiers unresolved. A chunk
+ * whose stream fills up waits for the main thread to grow it, and every chunk
+ * that did is lexed further in another round. Errors are kept with their
+ * chunk and printed in file order once every chunk is done. */
+#define INIT_TOKENS_LEN  32
+#define LEX_CHUNK_SIZE   (1 << 16)
+#define LEX_PARALLEL_MIN (LEX_CHUNK_SIZE * 4)
+#define LEX_CHUNK_TOKENS (LEX_CHUNK_SIZE / 4) // about 4 bytes per token in real code
+#define LEX_MAX_THREADS  16
+
+typedef struct {
+	Lexer          lex;
+	TokenStream    tokens;
+	bool           done; // reached the end of its part of the buffer
+	DoobleToken    eof;
+	LexDiagnostics diagnostics;
+} LexChunk;
+
+typedef struct {
+	LexChunk   *chunks;
+	u32         count;
+	atomic_uint next;
+} LexPool;
+
+static u32 lex_threads = 0; // 0 for one per core
+
+void limit_lex_threads(u32 threads) {
+	lex_threads = threads;
+}
+
+static u32 cpu_count(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+#endif
+}
+
+static void lex_chunk(LexChunk *chunk) {
+	let ts = &chunk->tokens;
+
+	while (!chunk->done && ts->len < ts->cap && ts->nvalues < ts->vcap) {
+		let tok = next_token(&chunk->lex);
+		if (tok.token == DB_EOF) {
+			chunk->done = true;
+			chunk->eof  = tok;
+			return;
+		}
+
+		push_token(ts, &tok);
+	}
+}
+
+static int lex_worker(void *arg) {
+	LexPool *pool = arg;
+
+	loop {
+		const u32 i = atomic_fetch_add(&pool->next, 1);
+		if (i >= pool->count) return 0;
+
+		lex_chunk(&pool->chunks[i]);
+	}
+}
+
+// runs workers over every chunk, the main thread is one of them
+static void lex_round(LexPool *pool, u32 workers) {
+	thrd_t threads[LEX_MAX_THREADS];
+	u32    spawned = 0;
+
+	atomic_store(&pool->next, 0);
+	while (spawned + 1 < workers
+			&& thrd_create(&threads[spawned], lex_worker, pool) == thrd_success)
+	{
+		spawned++;
+	}
+
+	lex_worker(pool);
+	for_range (i, spawned) thrd_join(threads[i], NULL);
+}
+
+// a float a worker left as NaN, a literal never is one
+static double relex_float(cstr buffer, u32 len, const LineTable *lines, u32 start) {
+	Lexer lex = init_lexer(buffer, len, lines);
+	lex.pos   = start;
+	lex.start = start;
+
+	return next_token(&lex).valf;
+}
+
+// moves a chunk's tokens onto the end of ts, interning the identifiers
+static void append_chunk(TokenStream *ts, const TokenStream *chunk, cstr buffer, u32 len, const LineTable *lines) {
+	while (ts->cap < ts->len + chunk->len) grow_token_stream(ts);
+
+	if (ts->vcap < ts->nvalues + chunk->nvalues) {
+		while (ts->vcap < ts->nvalues + chunk->nvalues) ts->vcap *= 2;
+		RESIZE(ts->values, ts->vcap);
+	}
+
+	memcpy(&ts->kinds[ts->len],      chunk->kinds,   sizeof(u8)  * chunk->len);
+	memcpy(&ts->offsets[ts->len],    chunk->offsets, sizeof(u32) * chunk->len);
+	memcpy(&ts->values[ts->nvalues], chunk->values,  sizeof(TokenValue) * chunk->nvalues);
+
+	for_range (i, chunk->len) {
+		u32 payload = chunk->payload[i];
+
+		if (chunk->kinds[i] == DB_IDENT) {
+			const u32 start = chunk->offsets[i];
+			payload = intern(&buffer[start], skip_ident(buffer, start, len) - start);
+		} else if (has_value(chunk->kinds[i])) {
+			payload += ts->nvalues;
+
+			if (chunk->kinds[i] == DB_FLOAT && isnan(ts->values[payload].valf)) {
+				ts->values[payload].valf = relex_float(buffer, len, lines, chunk->offsets[i]);
+			}
+		}
+
+		ts->payload[ts->len + i] = payload;
+	}
+
+	// brackets can pair up across chunks, so they are matched again here
+	const u32 first = ts->len;
+	ts->len     += chunk->len;
+	ts->nvalues += chunk->nvalues;
+
+	for (u32 i = first; i < ts->len; i++) match_bracket(ts, i);
+}
+
+static TokenStream get_tokens_parallel(cstr buffer, u32 len, const LineTable *lines) {
+	LexPool pool = {
+		.chunks = make(LexChunk, len / LEX_CHUNK_SIZE + 1),
+		.count  = 0,
+	};
+
+	u32 start = 0;
+	while (start < len) {
+		u32 end = len;
+
+		if (len - start > LEX_CHUNK_SIZE) {
+			end = find_newline(buffer, start + LEX_CHUNK_SIZE, len);
+			while (end < len && buffer[end] == '\n') end++;
+		}
+
+		let chunk = &pool.chunks[pool.count++];
+		chunk->lex               = init_lexer(buffer, end, lines);
+		chunk->lex.pos           = start;
+		chunk->lex.start         = start;
+		chunk->lex.defer_symbols = true;
+		chunk->lex.diagnostics   = &chunk->diagnostics;
+		chunk->tokens            = init_token_stream(LEX_CHUNK_TOKENS, false);
+
+		// matching would grow the open stack on a worker, and append_chunk
+		// matches every token again anyway
+		chunk->tokens.unmatched = true;
+
+		start = end;
+	}
+
+	u32 workers = lex_threads ? lex_threads : cpu_count();
+	if (workers > pool.count)      workers = pool.count;
+	if (workers > LEX_MAX_THREADS) workers = LEX_MAX_THREADS;
+
+	// dense code runs out of room, those chunks are grown here and go again
+	loop {
+		lex_round(&pool, workers);
+
+		bool full = false;
+		for_range (i, pool.count) {
+			let ts = &pool.chunks[i].tokens;
+			if (pool.chunks[i].done) continue;
+
+			if (ts->len >= ts->cap) grow_token_stream(ts);
+			if (ts->nvalues >= ts->vcap) {
+				ts->vcap *= 2;
+				RESIZE(ts->values, ts->vcap);
+			}
+
+			full = true;
+		}
+
+		if (!full) break;
+	}
+
+	TokenStream ts = init_token_stream(INIT_TOKENS_LEN, false);
+	for_range (i, pool.count) {
+		print_diagnostics(&pool.chunks[i].diagnostics, lines);
+		append_chunk(&ts, &pool.chunks[i].tokens, buffer, len, lines);
+		free_tokens(&pool.chunks[i].tokens);
+	}
+
+	// the EOF the whole buffer ends with
+	push_token(&ts, &pool.chunks[pool.count - 1].eof);
+
+	free(pool.chunks);
+	return ts;
+}
+
+TokenStream get_tokens(cstr buffer) {
+	const u32 len   = strlen(buffer);
+	LineTable lines = init_line_table(buffer, len);
+
+	if (len >= LEX_PARALLEL_MIN) {
+		TokenStream ts = get_tokens_parallel(buffer, len, &lines);
+		free_line_table(&lines);
+		return ts;
+	}
+
+	Lexer       lex = init_lexer(buffer, len, &lines);
+	TokenStream ts  = init_token_stream(INIT_TOKENS_LEN, false);
+
+	loop {
+		let tok = next_token(&lex);
+		push_token(&ts, &tok);
+
+		if (tok.token == DB_EOF) break;
+	}
+
+	free_line_table(&lines);
+	return ts;
+}
+
+string_t token_str(cstr buffer, const DoobleToken *token) {
+	return init_strn(&buffer[token->span.start], token->span.len);
+}
+
+void print_tokens(const TokenStream *ts, cstr buffer) {
+	for_range (i, ts->len) {
+		let tok = get_token(ts, i);
+		logger("Tok%0d ", tok.token);
+
+		switch (tok.token) {
 			case DB_ALLOC ... DB_YIELD: // keywords
-				logger("\t[key: \"%s\"]", KEYWORDS[tokens[i].token]);
+				logger("\t[key: \"%s\"]", KEYWORDS[tok.token]);
 				break;
 			case DB_NUM:
-				logger("\t[num: %d]", tokens[i].vali);
+				logger("\t[num: %d]", tok.vali);
 				break;
 			case DB_FLOAT:
-				logger("\t[num: %f]", tokens[i].valf);
+				logger("\t[num: %f]", tok.valf);
 				break;
 			case DB_STR:
-				fallthrough;
+				logger("\t[str: \"%.*s\"]",
+						(int) tok.span.len, &buffer[tok.span.start]);
+				break;
 			case DB_IDENT:
-				logger("\t[ident: \"%s\"]", tokens[i].str.str);
+				logger("\t[ident: \"%s\"]", symbol_str(tok.ident));
 				break;
 			default:
 				break;
@@ -412,21 +985,13 @@ void print_tokens(size_t N, DoobleToken tokens[N]) {
 	}
 }
 
-void free_tokens(u32 len, DoobleToken tokens[len]) {
-	for_range(i, len) {
-		const u8 tok = tokens[i].token;
-		if (tok == DB_STR || tok == DB_IDENT) {
-			freestr(&tokens[i].str);
-		}
-	}
-
-	free(tokens);
-}
-
-startup static void init_keywords(void) {
-	KEYWORD_SET = init_hashset();
-
-	for_range (i, KEYWORDS_LEN) {
-		add_item(&KEYWORD_SET, KEYWORDS[i]);
-	}
+// tokens only hold spans into the source, so there is nothing to free per token
+void free_tokens(TokenStream *ts) {
+	free(ts->kinds);
+	free(ts->offsets);
+	free(ts->payload);
+	free(ts->match);
+	free(ts->values);
+	free(ts->open.arr);
+	*ts = (TokenStream) {0};
 }
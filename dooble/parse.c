@@ -1,72 +1,221 @@
 #include "type.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #define DOOBLE_IMPL
 #include "dooble.h"
 #include "internal.h"
 
 // IMPORTANT: add documentation to the whole module
 
+#define TYPE_KEY_MAX     32 // words, longer types are walked every time
+#define MEMO_INIT_SLOTS  64 // power of 2
+
+// a type that was already parsed, see parse_type
+typedef struct {
+	u64    hash;
+	u32    key; // index of its first word in memo_keys
+	u32    len;
+	typeid type;
+} TypeMemo;
+
 typedef struct {
 	const char *const buffer;
 	size_t            position;
 	bool              parse_error; // TODO: implement parse error tracking
 
-	struct {
-		Node   *arr; // arr
-		size_t  len;
-		size_t  cap;
-	} ast_pool;
+	// nodes, child arrays and literal strings, so a node never moves once it
+	// has been handed out
+	Arena  arena;
+	size_t nodes;
 
-	struct {
-		DoobleToken *arr; // arr
-		size_t       len;
-	} tokens;
+	// children of the lists being parsed, see push_child
+	VEC(Node *) scratch;
+	VEC(u32)    bounds; // one per top level statement, see AstResult
+
+	VEC(TypeDecl) decls;     // see AstResult
+	VEC(Symbol)   redeclare; // types an earlier parse of the file declared, each may be declared again
+
+	// tokens are pulled from the lexer as the parser needs them. The ring only
+	// holds the window from the last consumed token to the furthest lookahead,
+	// it grows when a lookahead (the paren scan in atom) outruns it.
+	Lexer           *lexer;
+	const LineTable *lines;
+	TokenStream      tokens;
+	size_t           end; // tokens.len once DB_EOF has been pulled, SIZE_MAX before
 
 	TypeTree *type_tree;
+	Symbol    declaring; // the type a struct about to be parsed is named, see declaration
+
+	VEC(TypeMemo) memo;
+	VEC(u64)      memo_keys;
+	u32          *memo_slots; // index + 1 into memo, 0 is empty
+	u32           memo_mask;
 } Parse;
 
 static Node *append_node(Parse *p, Node *node) {
-	EXTEND_ARR(Node, p->ast_pool.arr, p->ast_pool.len, p->ast_pool.cap);
+	Node *dst = arena_new(&p->arena, Node);
+	*dst = *node;
 
-	p->ast_pool.arr[p->ast_pool.len++] = *node;
-	return &p->ast_pool.arr[p->ast_pool.len - 1];
+	p->nodes++;
+	return dst;
 }
 
-static DoobleToken *advance(Parse *p) {
-	if (p->position >= p->tokens.len) {
-		return NULL;
+/* Child lists (blocks, call parameters, function arguments) are collected on
+ * one scratch stack while they are parsed. A list remembers where it started,
+ * nested lists push on top of it and are popped before it carries on, then
+ * commit_children copies it into the arena at its final size. */
+static void push_child(Parse *p, Node *node) {
+	if (p->scratch.len >= p->scratch.cap) {
+		p->scratch.cap *= 2;
+
+		void *tmp = realloc(p->scratch.arr, sizeof(Node *) * p->scratch.cap);
+		if (tmp == NULL) PANIC("cannot extend child list");
+		p->scratch.arr = tmp;
 	}
 
-	return &p->tokens.arr[p->position++];
+	p->scratch.arr[p->scratch.len++] = node;
+}
+
+static void push_bound(Parse *p, u32 bound) {
+	if (p->bounds.len >= p->bounds.cap) {
+		p->bounds.cap *= 2;
+
+		void *tmp = realloc(p->bounds.arr, sizeof(u32) * p->bounds.cap);
+		if (tmp == NULL) PANIC("cannot extend statement bounds");
+		p->bounds.arr = tmp;
+	}
+
+	p->bounds.arr[p->bounds.len++] = bound;
+}
+
+static void push_decl(Parse *p, Symbol name, u32 offset) {
+	EXTEND_ARR(TypeDecl, p->decls.arr, p->decls.len, p->decls.cap);
+	p->decls.arr[p->decls.len++] = (TypeDecl) { .name = name, .offset = offset };
+}
+
+static void push_redeclare(Parse *p, Symbol name) {
+	EXTEND_ARR(Symbol, p->redeclare.arr, p->redeclare.len, p->redeclare.cap);
+	p->redeclare.arr[p->redeclare.len++] = name;
+}
+
+// true once for every name an earlier parse declared
+static bool take_redeclare(Parse *p, Symbol name) {
+	for_range (i, p->redeclare.len) {
+		if (p->redeclare.arr[i] != name) continue;
+
+		p->redeclare.arr[i] = p->redeclare.arr[--p->redeclare.len];
+		return true;
+	}
+
+	return false;
+}
+
+// pops everything pushed since `base`, NULL for an empty list
+static Node **commit_children(Parse *p, size_t base) {
+	const size_t len = p->scratch.len - base;
+	p->scratch.len = base;
+
+	if (len == 0) return NULL;
+
+	Node **arr = arena_make(&p->arena, Node *, len);
+	memcpy(arr, &p->scratch.arr[base], sizeof(Node *) * len);
+	return arr;
+}
+
+static bool is_closer(u8 tok) {
+	return tok == DB_RPAREN || tok == DB_RSQUARE || tok == DB_RBRACE;
+}
+
+static const char *bracket_str(u8 tok) {
+	switch (tok) {
+		case DB_LPAREN:  return "(";
+		case DB_RPAREN:  return ")";
+		case DB_LSQUARE: return "[";
+		case DB_RSQUARE: return "]";
+		case DB_LBRACE:  return "{";
+		case DB_RBRACE:  return "}";
+		default:         return "?";
+	}
+}
+
+// whatever is still open at DB_EOF, reported from the outermost in
+static void unclosed_brackets(Parse *p) {
+	for_range (i, p->tokens.open.len) {
+		let open = &p->tokens.open.arr[i];
+
+		p->parse_error = true;
+		error_at("unclosed '%s'", p->lines, open->offset, bracket_str(open->kind));
+	}
+}
+
+/* pulls from the lexer until the token at `index` (absolute, like position)
+ * is in the window. false past DB_EOF. */
+static bool fill_window(Parse *p, size_t index) {
+	while (p->tokens.len <= index) {
+		if (p->tokens.len >= p->end) return false;
+
+		// keep one consumed token around, the rules backtrack by one
+		const size_t oldest = p->position > 0 ? p->position - 1 : 0;
+		if (p->tokens.len - oldest >= p->tokens.cap) grow_token_stream(&p->tokens);
+
+		let tok = next_token(p->lexer);
+		push_token(&p->tokens, &tok);
+
+		if (tok.token == DB_EOF) {
+			p->end = p->tokens.len;
+			unclosed_brackets(p);
+		}
+
+		// brackets are matched as they are pushed, so a stray closer is known
+		// before any rule gets to it
+		else if (is_closer(tok.token) && p->tokens.match[(p->tokens.len - 1) & p->tokens.mask] == NO_MATCH) {
+			p->parse_error = true;
+			error_at("unbalanced '%s', it has no opening bracket",
+					p->lines, tok.offset, bracket_str(tok.token));
+		}
+	}
+
+	if (index + p->tokens.cap < p->tokens.len) {
+		PANIC("token has already left the parse window");
+	}
+
+	return true;
+}
+
+// the token is copied out of the window, so it stays valid across later pulls.
+// past the end it keeps returning DB_EOF without moving.
+static DoobleToken advance(Parse *p) {
+	if (!fill_window(p, p->position)) {
+		return (DoobleToken) { .token = DB_EOF };
+	}
+
+	return get_token(&p->tokens, p->position++);
 }
 
 static int peek_num(Parse *p, u8 num) {
-	if (p->position + num >= p->tokens.len) {
+	if (!fill_window(p, p->position + num)) {
 		return -1;
 	}
 
-	return p->tokens.arr[p->position + num].token;
+	return p->tokens.kinds[(p->position + num) & p->tokens.mask];
 }
 
 inline static int peek(Parse *p) {
 	return peek_num(p, 0);
 }
 
-static size_t peekline(Parse *p) {
-	if (p->position >= p->tokens.len) {
-		return 0;
+// where the next token starts, for diagnostics
+static u32 peek_offset(Parse *p) {
+	if (!fill_window(p, p->position)) {
+		return p->lexer->bufsize;
 	}
 
-	return p->tokens.arr[p->position].linenum;
+	return p->tokens.offsets[p->position & p->tokens.mask];
 }
 
 static bool match(Parse *p, u8 tok) {
-	if (p->position >= p->tokens.len) {
-		return false;
-	}
-
-	if (p->tokens.arr[p->position].token == tok) {
+	if (peek(p) == tok) {
 		p->position++;
 		return true;
 	}
@@ -74,21 +223,34 @@ static bool match(Parse *p, u8 tok) {
 	return false;
 }
 
-static DoobleToken *consume(Parse *p, u8 tok, cstr message) {
-	if (peek(p) == tok) return advance(p);
+// copies a token's text into the arena, it lives as long as the AST
+static string_t span_str(Parse *p, const DoobleToken *tok) {
+	char *str = arena_make(&p->arena, char, tok->span.len + 1);
+	memcpy(str, &p->buffer[tok->span.start], tok->span.len);
+
+	return (string_t) {
+		.str      = str,
+		.size     = tok->span.len,
+		.capacity = tok->span.len + 1,
+	};
+}
+
+static bool consume(Parse *p, u8 tok, DoobleToken *out, cstr message) {
+	if (peek(p) == tok) {
+		*out = advance(p);
+		return true;
+	}
 
 	p->parse_error = true;
-	error_file("expected token: %s",
-			p->tokens.arr[p->position].linenum, p->buffer, message);
-	return NULL;
+	error_at("expected token: %s", p->lines, peek_offset(p), message);
+	return false;
 }
 
 static bool expect(Parse *p, u8 tok, cstr message) {
 	if (match(p, tok)) return true;
 
 	p->parse_error = true;
-	error_file("expected token: %s",
-			p->tokens.arr[p->position].linenum, p->buffer, message);
+	error_at("expected token: %s", p->lines, peek_offset(p), message);
 	return false;
 }
 
@@ -114,7 +276,7 @@ typedef enum : u16 {
 } TypeState;
 
 enum : u16 {
-	NONE_SET   = TS_OPT  | TS_RES | TS_PTR | TS_ARR  | TS_FUNC | TS_NAME | TS_STRUCT,
+	NONE_SET   = TS_NONE | TS_OPT | TS_RES | TS_PTR  | TS_ARR  | TS_FUNC | TS_NAME | TS_STRUCT,
 	RES_SET    = TS_NONE | TS_OPT | TS_PTR | TS_ARR  | TS_FUNC | TS_NAME | TS_STRUCT,
 	OPT_SET    = TS_NONE | TS_PTR | TS_ARR | TS_FUNC | TS_NAME | TS_STRUCT,
 	PTR_SET    = TS_OPT  | TS_PTR | TS_ARR | TS_FUNC | TS_NAME | TS_STRUCT,
@@ -129,10 +291,25 @@ enum : u16 {
 
 static typeid parse_type(Parse *p);
 
-static TypeLeaf *parse_arr(Parse *p, TypeLeaf *leaf) {
-	DoobleToken *tok = advance(p);
+// what a token does in a type, TS_NONE for one that ends it
+static TypeState type_state(u8 kind) {
+	switch (kind) {
+		case DB_QUEST:   return TS_OPT;
+		case DB_BANG:    return TS_RES;
+		case DB_STAR:    return TS_PTR;
+		case DB_LSQUARE: return TS_ARR;
+		case DB_LPAREN:  return TS_FUNC;
+		case DB_IDENT:   return TS_NAME;
+		case DB_STRUCT:  return TS_STRUCT;
+		case DB_SUMTYPE: return TS_SUM;
+		default:         return TS_NONE;
+	}
+}
+
+static typeid parse_arr(Parse *p, typeid leaf) {
+	DoobleToken tok = advance(p);
 
-	switch (tok->token) {
+	switch (tok.token) {
 		case DB_RSQUARE:
 			return GET_LEAF(DBLTP_SLICE);
 		case DB_VEC:
@@ -140,10 +317,10 @@ static TypeLeaf *parse_arr(Parse *p, TypeLeaf *leaf) {
 			return GET_LEAF(DBLTP_VEC);
 		case DB_NUM:
 			expect(p, DB_RSQUARE, "expected ']'");
-			return GET_LEAF(.tag = DBLTP_ARR, .size = tok->vali);
+			return GET_LEAF(.tag = DBLTP_ARR, .size = tok.vali);
 
 		default:
-			error_file("unexpeced token in array type", peekline(p), p->buffer);
+			error_at("unexpeced token in array type", p->lines, peek_offset(p));
 			break;
 	}
 
@@ -152,7 +329,7 @@ static TypeLeaf *parse_arr(Parse *p, TypeLeaf *leaf) {
 
 // (int, *hello)
 
-static TypeLeaf *parse_fntype(Parse *p, TypeLeaf *leaf) {
+static typeid parse_fntype(Parse *p, typeid leaf) {
 	TypeLeaf fn = {
 		.tag = DBLTP_FN,
 		.fn = {
@@ -170,9 +347,12 @@ static TypeLeaf *parse_fntype(Parse *p, TypeLeaf *leaf) {
 	}
 
 	expect(p, DB_RPAREN, "expected ')'");
-	fn.fn.ret = match(p, DB_ARROW) ? parse_type(p) : NULL;
+	fn.fn.ret = match(p, DB_ARROW) ? parse_type(p) : VOID_ID;
 
-	return get_leaf(p->type_tree, leaf, &fn);
+	// the leaf keeps its own copy of the arguments
+	typeid type = get_leaf(p->type_tree, leaf, &fn);
+	free(fn.fn.arr);
+	return type;
 }
 
 /*
@@ -195,31 +375,34 @@ Player :: struct {
 /* parses a struct starting at the first brace.
  * assumes that the 'struct' keyword has already been consumed.
  * for now it assumes that all default values are 0 */
-static TypeLeaf *parse_struct(Parse *p, TypeLeaf *leaf, bool is_union) {
+static typeid parse_struct(Parse *p, typeid leaf, bool is_union, Symbol named) {
 	expect(p, DB_LBRACE, "expected '{' after struct");
 
 	TypeLeaf ztruct = {
 		.tag     = is_union ? DBLTP_UNION : DBLTP_STRUCT,
 		.members = {
-			.arr = make(Member, 5),
-			.len = 0,
-			.cap = 5,
+			.arr   = make(Member, 5),
+			.len   = 0,
+			.cap   = 5,
+			.named = named,
 		},
 	};
 
 	// WARN: this is not flexable if I wanted to add default values
 	while (!match(p, DB_RBRACE)) {
-		let name = consume(p, DB_IDENT, "expected identifier as member of struct");
-		if (name == NULL) return NULL;
+		DoobleToken name;
+		if (!consume(p, DB_IDENT, &name, "expected identifier as member of struct")) {
+			return VOID_ID;
+		}
 
 		bool colon = expect(p, DB_COLON, "expected colon after member in struct");
-		if (!colon) return NULL;
+		if (!colon) return VOID_ID;
 
 		typeid type = parse_type(p);
-		if (type == NULL) {
-			error_file("expected valid type after struct member",
-					name->linenum, p->buffer);
-			return NULL;
+		if (type == VOID_ID) {
+			error_at("expected valid type after struct member",
+					p->lines, name.offset);
+			return VOID_ID;
 		}
 
 		expect(p, DB_SEMI, "expected ';' or newline character");
@@ -227,48 +410,38 @@ static TypeLeaf *parse_struct(Parse *p, TypeLeaf *leaf, bool is_union) {
 		EXTEND_ARR(Member, ztruct.members.arr, ztruct.members.len, ztruct.members.cap);
 		ztruct.members.arr[ztruct.members.len++] = (Member) {
 			.type = type,
-			.name = copy_str(&name->str),
+			.name = name.ident,
 		};
 	}
 
-	return get_leaf(p->type_tree, leaf, &ztruct);
+	typeid type = get_leaf(p->type_tree, leaf, &ztruct);
+	free(ztruct.members.arr);
+	return type;
 }
 
-static typeid parse_type(Parse *p) {
-	TypeState  current = TS_NONE;
-	TypeLeaf  *leaf    = NULL;
+// walks the type at the current position through the TypeTree, a leaf per
+// modifier. parse_type is the way in, it skips this for types it has seen
+static typeid walk_type(Parse *p) {
+	TypeState current = TS_NONE;
+	typeid    leaf    = VOID_ID;
 
-	loop {
-		DoobleToken *tok  = advance(p);
-		TypeState    next = TS_NONE;
+	// taken here so the structs in its members are literals
+	const Symbol declaring = p->declaring;
+	p->declaring = NO_SYMBOL;
 
-		if (tok == NULL) {
-			error_file("type collides with EOF", peekline(p), p->buffer);
-			return NULL;
+	loop {
+		if (!fill_window(p, p->position)) {
+			p->parse_error = true;
+			error_at("type collides with EOF", p->lines, peek_offset(p));
+			return VOID_ID;
 		}
 
-		switch (tok->token) {
-			case DB_QUEST:   next = TS_OPT;    break;
-			case DB_BANG:    next = TS_RES;    break;
-			case DB_STAR:    next = TS_PTR;    break;
-			case DB_LSQUARE: next = TS_ARR;    break;
-			case DB_LPAREN:  next = TS_FUNC;   break;
-			case DB_IDENT:   next = TS_NAME;   break;
-			case DB_STRUCT:  next = TS_STRUCT; break;
-			case DB_SUMTYPE: next = TS_SUM;    break;
-			
-			case DB_EQUAL:
-			case DB_COLON:
-			case DB_SEMI:
-			case DB_EOF:
-				p->position--;
-				next = TS_NONE;
-				break;
+		DoobleToken tok  = advance(p);
+		TypeState   next = type_state(tok.token);
 
-			default:
-				// ...
-				break;
-		}
+		// anything else ends the type and is left for the caller,
+		// (a: int, b: int) ends on ',' and ')', fn bodies on '{'
+		if (next == TS_NONE) p->position--;
 
 		bool is_valid = false;
 		switch (current) {
@@ -283,9 +456,10 @@ static typeid parse_type(Parse *p) {
 			case TS_SUM:    is_valid = (STRUCT_SET & next); break;
 		}
 
-		if (is_valid != 0) {
-			error_file("invalid type", peekline(p), p->buffer);
-			return NULL;
+		if (!is_valid) {
+			p->parse_error = true;
+			error_at("invalid type", p->lines, peek_offset(p));
+			return VOID_ID;
 		}
 
 		switch (next) {
@@ -298,11 +472,11 @@ static typeid parse_type(Parse *p) {
 
 			case TS_ARR:    leaf = parse_arr(p, leaf);           break;
 			case TS_FUNC:   leaf = parse_fntype(p, leaf);        break;
-			case TS_STRUCT: leaf = parse_struct(p, leaf, false); break;
-			case TS_SUM:    leaf = parse_struct(p, leaf, true);  break;
+			case TS_STRUCT: leaf = parse_struct(p, leaf, false, declaring); break;
+			case TS_SUM:    leaf = parse_struct(p, leaf, true,  declaring); break;
 
 			case TS_NAME:
-				leaf = GET_LEAF(.tag = DBLTP_NAME, .name = copy_str(&tok->str));
+				leaf = GET_LEAF(.tag = DBLTP_NAME, .name = tok.ident);
 				break;
 
 			case TS_NONE:
@@ -313,6 +487,182 @@ static typeid parse_type(Parse *p) {
 	}
 }
 
+/* Field and argument types repeat a lot (*[]Foo, ?int), so a type is
+ * remembered by its tokens once it has been walked: the kind of each one, with
+ * the symbol of a name and the size of an array. Seeing it again costs a scan
+ * over the same tokens and a hash instead of a get_leaf per modifier.
+ * A type with a struct or sumtype literal in it is never remembered, the
+ * members are not in its tokens. */
+typedef struct {
+	u64 words[TYPE_KEY_MAX];
+	u32 len;
+	u64 hash;
+} TypeKey;
+
+static u32 memo_slot(u64 hash, u32 mask) {
+	return (u32) (hash >> 32) & mask;
+}
+
+static bool key_word(TypeKey *key, u64 word) {
+	if (key->len >= TYPE_KEY_MAX) return false;
+
+	key->words[key->len++] = word;
+	key->hash = (key->hash ^ word) * 0x100000001b3; // FNV-1a, a word at a time
+	return true;
+}
+
+// false for a token that keeps the type from being remembered
+static bool key_token(Parse *p, TypeKey *key, size_t index) {
+	const u32 slot = index & p->tokens.mask;
+	const u8  kind = p->tokens.kinds[slot];
+
+	switch (kind) {
+		case DB_STRUCT:
+		case DB_SUMTYPE:
+			return false;
+		case DB_IDENT:
+			return key_word(key, (u64) p->tokens.payload[slot] << 8 | kind);
+		case DB_NUM:
+			return key_word(key, kind)
+				&& key_word(key, get_token(&p->tokens, index).vali);
+		default:
+			return key_word(key, kind);
+	}
+}
+
+/* builds the key of the type at the current position, and finds the token
+ * after it. Reads the tokens the way walk_type does: modifiers and array
+ * brackets carry on, a name or a function type ends the type, anything else
+ * ends it without being part of it. */
+static bool type_key(Parse *p, TypeKey *key, size_t *end) {
+	*key = (TypeKey) { .hash = 0xcbf29ce484222325 };
+
+	for (size_t i = p->position;;) {
+		if (!fill_window(p, i)) return false;
+		const u8 kind = p->tokens.kinds[i & p->tokens.mask];
+
+		switch (kind) {
+			case DB_QUEST:
+			case DB_BANG:
+			case DB_STAR:
+				if (!key_token(p, key, i++)) return false;
+				break;
+
+			case DB_IDENT:
+				*end = i + 1;
+				return key_token(p, key, i);
+
+			case DB_LSQUARE:
+			case DB_LPAREN: {
+				const size_t open = i;
+				while (p->tokens.match[open & p->tokens.mask] == NO_MATCH
+						&& fill_window(p, p->tokens.len)) {}
+
+				const u32 close = p->tokens.match[open & p->tokens.mask];
+				if (close == NO_MATCH) return false;
+
+				for (; i <= close; i++) {
+					if (!key_token(p, key, i)) return false;
+				}
+
+				if (kind == DB_LPAREN) {
+					// a function type ends with its return type, if it has one
+					if (!fill_window(p, i) || p->tokens.kinds[i & p->tokens.mask] != DB_ARROW) {
+						*end = i;
+						return true;
+					}
+
+					if (!key_token(p, key, i++)) return false;
+				}
+			} break;
+
+			// no type at all is left to walk_type, it is cheap already
+			default:
+				*end = i;
+				return key->len > 0;
+		}
+	}
+}
+
+static void grow_memo_slots(Parse *p) {
+	const u32 cap = (p->memo_mask + 1) * 2;
+
+	free(p->memo_slots);
+	p->memo_slots = make(u32, cap);
+	p->memo_mask  = cap - 1;
+	if (p->memo_slots == NULL) PANIC("could not extend type memo");
+
+	for_range (i, p->memo.len) {
+		u32 slot = memo_slot(p->memo.arr[i].hash, p->memo_mask);
+		while (p->memo_slots[slot] != 0) slot = (slot + 1) & p->memo_mask;
+
+		p->memo_slots[slot] = i + 1;
+	}
+}
+
+static void remember_type(Parse *p, const TypeKey *key, typeid type) {
+	if (p->memo.len >= p->memo.cap) {
+		p->memo.cap *= 2;
+
+		void *tmp = realloc(p->memo.arr, sizeof(TypeMemo) * p->memo.cap);
+		if (tmp == NULL) PANIC("could not extend type memo");
+		p->memo.arr = tmp;
+	}
+
+	while (p->memo_keys.len + key->len > p->memo_keys.cap) {
+		p->memo_keys.cap *= 2;
+
+		void *tmp = realloc(p->memo_keys.arr, sizeof(u64) * p->memo_keys.cap);
+		if (tmp == NULL) PANIC("could not extend type memo");
+		p->memo_keys.arr = tmp;
+	}
+
+	memcpy(&p->memo_keys.arr[p->memo_keys.len], key->words, sizeof(u64) * key->len);
+	p->memo.arr[p->memo.len++] = (TypeMemo) {
+		.hash = key->hash,
+		.key  = p->memo_keys.len,
+		.len  = key->len,
+		.type = type,
+	};
+	p->memo_keys.len += key->len;
+
+	u32 slot = memo_slot(key->hash, p->memo_mask);
+	while (p->memo_slots[slot] != 0) slot = (slot + 1) & p->memo_mask;
+	p->memo_slots[slot] = p->memo.len;
+
+	// kept at most half full
+	if (p->memo.len * 2 > p->memo_mask + 1) grow_memo_slots(p);
+}
+
+static typeid parse_type(Parse *p) {
+	TypeKey key;
+	size_t  end;
+	if (!type_key(p, &key, &end)) return walk_type(p);
+
+	u32 slot = memo_slot(key.hash, p->memo_mask);
+	for (; p->memo_slots[slot] != 0; slot = (slot + 1) & p->memo_mask) {
+		const TypeMemo *memo = &p->memo.arr[p->memo_slots[slot] - 1];
+
+		if (memo->hash == key.hash && memo->len == key.len
+				&& memcmp(&p->memo_keys.arr[memo->key], key.words, sizeof(u64) * key.len) == 0)
+		{
+			// a remembered type ends in a name or a function, which nothing
+			// may follow. `int*` is walked again so the error is reported
+			if (!fill_window(p, end) || type_state(p->tokens.kinds[end & p->tokens.mask]) != TS_NONE) break;
+
+			p->position = end;
+			return memo->type;
+		}
+	}
+
+	// only a type that was read the way type_key saw it is remembered, a
+	// broken one is walked again so its errors are reported every time
+	typeid type = walk_type(p);
+	if (type != VOID_ID && p->position == end) remember_type(p, &key, type);
+
+	return type;
+}
+
 // == statements ==
 static Node *statement(Parse *p);
 static Node *ifstmt(Parse *p);
@@ -324,72 +674,258 @@ static Node *block(Parse *p);
 static Node *declaration(Parse *p);
 
 // == expressions ==
-static Node *range(Parse *p);
 static Node *expression(Parse *p);
 static Node *logic(Parse *p);
-static Node *equality(Parse *p);
-static Node *comparison(Parse *p);
-static Node *bit_wise(Parse *p);
-static Node *sum(Parse *p);
-static Node *factor(Parse *p);
 static Node *unary(Parse *p);
 static Node *call(Parse *p);
 static Node *atom(Parse *p);
 
-AstResult get_ast(size_t N, DoobleToken tokens[N], TypeTree *tree, const char *const buf) {
-	const u8 POOL_INIT_SIZE = 100;
-
+#define TOKEN_WINDOW_INIT 16 // power of 2
+#define BYTES_PER_NODE    8  // of source, see parse_all
+#define SCRATCH_INIT      64 // deepest nesting of child lists, times their length
+static Parse init_parse(Lexer *lexer, TypeTree *tree, Arena arena) {
 	Parse parse = {
-		.buffer   = buf,
+		.buffer   = lexer->buffer,
 		.position = 0,
-		.ast_pool = {
-			.arr = malloc(sizeof(Node) * POOL_INIT_SIZE),
+		.arena    = arena,
+		.nodes    = 0,
+		.scratch  = {
+			.arr = make(Node *, SCRATCH_INIT),
 			.len = 0,
-			.cap = POOL_INIT_SIZE,
+			.cap = SCRATCH_INIT,
 		},
-		.tokens = {
-			.arr = tokens,
-			.len = N,
+		.bounds   = {
+			.arr = make(u32, SCRATCH_INIT),
+			.len = 0,
+			.cap = SCRATCH_INIT,
 		},
+		.decls     = { .arr = make(TypeDecl, 4), .cap = 4 },
+		.redeclare = { .arr = make(Symbol, 4),   .cap = 4 },
+		.lexer  = lexer,
+		.lines  = lexer->lines,
+		.tokens = init_token_stream(TOKEN_WINDOW_INIT, true),
+		.end    = SIZE_MAX,
 		.type_tree = tree,
-	};
 
-	// will always be the first element
-	let global_scope = append_node(&parse, &(Node) {
-		.tag   = EX_BLOCK,
-		.block = {
-			.arr = make(Node *, 10), // OPTIM: find ideal scope size
+		.memo       = {
+			.arr = make(TypeMemo, MEMO_INIT_SLOTS / 2),
 			.len = 0,
-			.cap = 10,
+			.cap = MEMO_INIT_SLOTS / 2,
 		},
-	});
+		.memo_keys  = {
+			.arr = make(u64, MEMO_INIT_SLOTS),
+			.len = 0,
+			.cap = MEMO_INIT_SLOTS,
+		},
+		.memo_slots = make(u32, MEMO_INIT_SLOTS),
+		.memo_mask  = MEMO_INIT_SLOTS - 1,
+	};
+
+	if (parse.scratch.arr == NULL || parse.bounds.arr == NULL) {
+		PANIC("could not allocate child lists");
+	}
+
+	if (parse.memo.arr == NULL || parse.memo_keys.arr == NULL || parse.memo_slots == NULL) {
+		PANIC("could not allocate type memo");
+	}
+
+	return parse;
+}
+
+// everything but the arena, which goes to the AST
+static void free_parse(Parse *p) {
+	free_tokens(&p->tokens);
+	free(p->scratch.arr);
+	free(p->bounds.arr);
+	free(p->decls.arr);
+	free(p->redeclare.arr);
+	free(p->memo.arr);
+	free(p->memo_keys.arr);
+	free(p->memo_slots);
+}
+
+// top level statements until the lexer runs out. Each one that makes it into
+// the global scope records where its separator ends.
+static void global_statements(Parse *p) {
+	while (!match(p, DB_EOF)) {
+		const size_t start = p->position;
+
+		Node *expr = statement(p);
+		const bool separated = expect(p, DB_SEMI, "expected ';' or newline character");
 
-	while (!match(&parse, DB_EOF)) {
-		EXTEND_ARR(Node *,
-				global_scope->block.arr,
-				global_scope->block.len,
-				global_scope->block.len);
+		// a stray token no statement starts with, like the ']' of `x: int[]`
+		if (!separated && p->position == start) advance(p);
 
-		Node *expr = statement(&parse);
 		if (expr != NULL) {
-			global_scope->block.arr[global_scope->block.len++] = expr;
+			push_child(p, expr);
+			push_bound(p, separated
+					? p->tokens.offsets[(p->position - 1) & p->tokens.mask] + 1
+					: peek_offset(p));
 		}
+	}
+}
 
-		expect(&parse, DB_SEMI, "expected ';' or newline character");
+// moves the global statements into the arena, the last one reaches to the end
+// of the buffer so the bounds cover all of it
+static AstResult finish_ast(Parse *p, Node *global_scope) {
+	let scope = &global_scope->block;
+	const size_t len = p->scratch.len;
+
+	scope->len = len;
+	scope->cap = len;
+	scope->arr = commit_children(p, 0);
+
+	u32 *bounds = NULL;
+	if (len > 0) {
+		bounds = arena_make(&p->arena, u32, len);
+		memcpy(bounds, p->bounds.arr, sizeof(u32) * len);
+		bounds[len - 1] = p->lexer->bufsize;
 	}
 
-	// free tokens block
-	free_tokens(N, tokens);
-	parse.tokens.arr = NULL;
+	// the ones the new file didn't declare again are still in the tree
+	for_range (i, p->redeclare.len) push_decl(p, p->redeclare.arr[i], DECL_GONE);
+
+	const u32 ndecls = p->decls.len;
+	TypeDecl *decls  = arena_make(&p->arena, TypeDecl, ndecls);
+	if (ndecls > 0) memcpy(decls, p->decls.arr, sizeof(TypeDecl) * ndecls);
+
+	free_parse(p);
 
-	// might be unnecessary copying
 	return (AstResult) {
-		.err       = parse.parse_error,
+		.err       = p->parse_error,
 		.pool      = global_scope,
-		.pool_size = parse.ast_pool.len,
+		.pool_size = p->nodes,
+		.bounds    = bounds,
+		.decls     = decls,
+		.ndecls    = ndecls,
+		.arena     = p->arena,
 	};
 }
 
+// the whole buffer, `declared` are the types of an earlier parse of it
+static AstResult parse_all(Lexer *lexer, TypeTree *tree, const TypeDecl *declared, u32 count) {
+	// the bench sources take 2.6 to 4.5 bytes per node, but a file of type
+	// declarations makes hardly any. The guess stays low so those don't pay for
+	// nodes they never make, denser files grow into doubled chunks instead
+	let arena = init_arena(sizeof(Node) * (lexer->bufsize / BYTES_PER_NODE + 1));
+	Parse parse = init_parse(lexer, tree, arena);
+	for_range (i, count) push_redeclare(&parse, declared[i].name);
+
+	// will always be the first element
+	let global_scope = append_node(&parse, &(Node) {
+		.tag = EX_BLOCK,
+	});
+
+	global_statements(&parse);
+	return finish_ast(&parse, global_scope);
+}
+
+AstResult get_ast(Lexer *lexer, TypeTree *tree) {
+	return parse_all(lexer, tree, NULL, 0);
+}
+
+/* Parses the top level statements in [start, end) of the new buffer on their
+ * own. The run starts right after a separator, like the lexer does at the top
+ * of a file. Every statement has to end in a separator and brackets can't be
+ * left open, so a run that parses cleanly leaves the lexer in the same state
+ * the statements after it were lexed in. */
+static bool reparse_run(Parse *p, Lexer *lexer, u32 start, u32 end) {
+	Lexer run = *lexer;
+	run.pos     = start;
+	run.start   = start;
+	run.bufsize = end;
+	run.last    = DB_SEMI;
+
+	clear_tokens(&p->tokens);
+	p->position = 0;
+	p->end      = SIZE_MAX;
+	p->lexer    = &run;
+
+	// a run that fails is parsed again with the whole file, which reports
+	// the real errors
+	mute_errors(true);
+	global_statements(p);
+	mute_errors(false);
+
+	p->lexer = lexer;
+	return !p->parse_error;
+}
+
+AstResult reparse_ast(AstResult *old, Lexer *lexer, TypeTree *tree, const Edit *edits, u32 count) {
+	let global_scope = old->pool;
+	const size_t len = global_scope->block.len;
+
+	// without clean statement boundaries there is nothing to reuse
+	if (old->err || len == 0) {
+		AstResult full = parse_all(lexer, tree, old->decls, old->ndecls);
+		free_ast(old);
+		return full;
+	}
+
+	// the old tree's arena is taken over, the replaced statements are left in it
+	Parse parse = init_parse(lexer, tree, old->arena);
+	parse.nodes = old->pool_size;
+
+	Node     **stmts  = global_scope->block.arr;
+	const u32 *bounds = old->bounds;
+	i64        shift  = 0; // new offset - old offset, past the edits so far
+	size_t     e      = 0;
+
+	// declarations in kept statements move with them, the ones in runs may be
+	// declared again by any run. Gone ones come last
+	const TypeDecl *decls = old->decls;
+	size_t          d     = 0;
+	for_range (k, old->ndecls) {
+		if (decls[k].offset == DECL_GONE) push_redeclare(&parse, decls[k].name);
+	}
+
+	for (size_t i = 0; i < len;) {
+		if (e == count || edits[e].start > bounds[i]) {
+			for (; d < old->ndecls && decls[d].offset < bounds[i]; d++) {
+				push_decl(&parse, decls[d].name, decls[d].offset + shift);
+			}
+
+			push_child(&parse, stmts[i]);
+			push_bound(&parse, bounds[i] + shift);
+			i++;
+			continue;
+		}
+
+		// the run of statements the next edits touch. An edit that reaches a
+		// boundary takes the statement after it too, the separator might be
+		// what changed
+		const u32 start = (i > 0 ? bounds[i - 1] : 0) + shift;
+		size_t    last  = i;
+
+		while (e < count && edits[e].start <= bounds[last]) {
+			while (last + 1 < len && bounds[last] <= edits[e].end) last++;
+
+			shift += (i64) edits[e].len - (edits[e].end - edits[e].start);
+			e++;
+		}
+
+		for (; d < old->ndecls && decls[d].offset < bounds[last]; d++) {
+			push_redeclare(&parse, decls[d].name);
+		}
+
+		const u32 end = last + 1 == len ? lexer->bufsize : bounds[last] + shift;
+		if (!reparse_run(&parse, lexer, start, end)) {
+			free_parse(&parse);
+
+			AstResult full = parse_all(lexer, tree, old->decls, old->ndecls);
+			free_arena(&parse.arena);
+
+			*old = (AstResult) {0};
+			return full;
+		}
+
+		i = last + 1;
+	}
+
+	*old = (AstResult) {0};
+	return finish_ast(&parse, global_scope);
+}
+
 // === STATEMENTS ===
 
 static Node *statement(Parse *p) {
@@ -474,8 +1010,8 @@ static Node *forstmt(Parse *p) {
 
 	// for &i in array[:-1] ...
 	if (peek(p) == DB_IDENT && peek_num(p, 1) == DB_IN) {
-		string_t  ident = copy_str(&advance(p)->str);
-		Node     *range = expression(p);
+		Symbol  ident = advance(p).ident;
+		Node   *range = expression(p);
 
 		return append_node(p, &(Node) {
 			.tag     = EX_FOREACH,
@@ -493,7 +1029,7 @@ static Node *forstmt(Parse *p) {
 		Node *condition = logic(p);
 
 		if (condition == NULL) {
-			error_file("expected condition after 'for'", peekline(p), p->buffer);
+			error_at("expected condition after 'for'", p->lines, peek_offset(p));
 		}
 
 		return append_node(p, &(Node) {
@@ -511,23 +1047,23 @@ static Node *forstmt(Parse *p) {
 static Node *dostmt(Parse *p, bool dont) {
 	if (!match(p, DB_DO)) return NULL;
 
-	size_t mark = p->position;
-	Node  *stmt = statement(p);
+	Node *stmt = statement(p);
 
 	if (peek(p) != DB_FOR) {
 		// do to how the pool allocator works, the prior 'stmt' will not get
 		// freed until the entire pool is dumped, but it will get freed.
+		// The statement's tokens are already out of the window, so parsing
+		// carries on after it instead of rewinding.
 
-		p->position    = mark;
 		p->parse_error = true;
-		error_file("expected 'for'", peekline(p), p->buffer);
+		error_at("expected 'for'", p->lines, peek_offset(p));
 		return NULL;
 	}
 
 	let fornode = forstmt(p);
 	if (fornode == NULL) {
 		p->parse_error = true;
-		error_file("expected for statement", peekline(p), p->buffer);
+		error_at("expected for statement", p->lines, peek_offset(p));
 		return NULL;
 	}
 
@@ -548,30 +1084,27 @@ static Node *block(Parse *p) {
 
 	let expr = append_node(p, &(Node) {
 		.tag = EX_BLOCK,
-		.block = {
-			.arr = make(Node *, 2), // OPTIM: find the optimal number for a block
-			.len = 0,
-			.cap = 2,
-		},
 	});
 
+	const size_t base = p->scratch.len;
 	while (!match(p, DB_RBRACE)) {
 		if (peek(p) == DB_EOF) {
-			error_file("expected '}'", peekline(p), p->buffer);
+			error_at("expected '}'", p->lines, peek_offset(p));
 		}
 
-		EXTEND_ARR(Node *, expr->block.arr, expr->block.len, expr->block.cap);
 		Node *stmt = statement(p);
-		if (stmt != NULL) {
-			expr->block.arr[expr->block.len++] = stmt;
-		}
+		if (stmt != NULL) push_child(p, stmt);
 
 		if (!expect(p, DB_SEMI, "expected ';' xor newline character")) {
-			free(expr->block.arr);
+			p->scratch.len = base;
 			return NULL;
 		}
 	}
 
+	expr->block.len = p->scratch.len - base;
+	expr->block.cap = expr->block.len;
+	expr->block.arr = commit_children(p, base);
+
 	return expr;
 }
 
@@ -581,15 +1114,16 @@ static Node *declaration(Parse *p) {
 	if (peek(p) != DB_IDENT) return NULL;
 
 	Node *expr = append_node(p, &(Node) { .tag = EX_DECL });
-	expr->declare.name = copy_str(&advance(p)->str);
+	const DoobleToken name = advance(p);
+	expr->declare.name = name.ident;
 
 	loop {
-		let tok = advance(p)->token;
+		let tok = advance(p).token;
 		if (tok == DB_COLON) break;
 		if (tok == DB_EOF) {
 			p->parse_error = true;
-			error_file("expected colon after identifier %s",
-					peekline(p), p->buffer, expr->declare.name.str);
+			error_at("expected colon after identifier %s",
+					p->lines, peek_offset(p), symbol_str(expr->declare.name));
 			return NULL;
 		}
 
@@ -604,36 +1138,49 @@ static Node *declaration(Parse *p) {
 
 	int tok = peek(p);
 	if (tok == DB_COLON || tok == DB_EQUAL) {
-		expr->declare.is_const = advance(p)->token == DB_COLON;
+		expr->declare.is_const = advance(p).token == DB_COLON;
 
-		if (peek(p) == DB_STRUCT
-				|| peek(p) == DB_SUMTYPE
-				|| match(p, DB_ALIAS)) // consume the alias token, but leave sum & struct
-		{
+		// `Name :: struct` is a type of its own, `Name :: alias struct` is
+		// only another name for the literal
+		const bool nominal = peek(p) == DB_STRUCT || peek(p) == DB_SUMTYPE;
+
+		if (nominal || match(p, DB_ALIAS)) { // consume the alias token, but leave sum & struct
 			TypeLeaf named_leaf = {
 				.tag  = DBLTP_NAME,
 				.name = expr->declare.name,
 			};
 
-			if (!leaf_exists(p->type_tree, NULL, &named_leaf)) {
-				error_file("type %s is already defined", peekline(p),
-						p->buffer, expr->declare.name);
+			const bool again = type_declared(p->type_tree, expr->declare.name);
+			if (again && !take_redeclare(p, expr->declare.name)) {
+				error_at("type %s is already defined", p->lines,
+						peek_offset(p), symbol_str(expr->declare.name));
 				p->parse_error = true;
 				return NULL;
 			}
 
-			typeid named_type = get_leaf(p->type_tree, NULL, &named_leaf);
-			freestr(&named_leaf.name);
+			typeid named_type = get_leaf(p->type_tree, VOID_ID, &named_leaf);
+
+			p->declaring = nominal ? expr->declare.name : NO_SYMBOL;
+			typeid type  = parse_type(p);
+			p->declaring = NO_SYMBOL;
 
-			typeid type = parse_type(p);
 			if (type == VOID_ID) {
-				error_file("type %s has invalid type", peekline(p),
-						p->buffer, expr->declare.name);
+				error_at("type %s has invalid type", p->lines,
+						peek_offset(p), symbol_str(expr->declare.name));
+				p->parse_error = true;
+				return NULL;
+			}
+
+			// declared by an earlier parse of the file, it has to stay the same
+			if (again && canonical_type(p->type_tree, named_type) != canonical_type(p->type_tree, type)) {
+				error_at("type %s changed since the file was parsed", p->lines,
+						name.offset, symbol_str(expr->declare.name));
 				p->parse_error = true;
 				return NULL;
 			}
 
-			add_typedef(p->type_tree, named_type, type);
+			if (!again) add_typedef(p->type_tree, named_type, type);
+			push_decl(p, expr->declare.name, name.offset);
 			return NULL;
 		}
 		else expr->declare.assign = expression(p);
@@ -644,144 +1191,74 @@ static Node *declaration(Parse *p) {
 
 // === EXPRESSIONS ===
 
-static inline Node *expression(Parse *p) {
-	return range(p);
-}
-
-static Node *range(Parse *p) {
-	let expr = logic(p);
-
-	if (match(p, DB_DOTDOT)) {
-		let left = expr;
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = DB_DOTDOT,
-				.expra    = left,
-				.exprb    = logic(p),
-			},
-		});
-	}
-
-	return expr;
-}
-
-static Node *logic(Parse *p) {
-	let expr = equality(p);
-
-	while (peek(p) == DB_AND || peek(p) == DB_OR) {
-		let left = expr;
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = advance(p)->token,
-				.expra    = left,
-				.exprb    = equality(p),
-			},
-		});
-	}
-
-	return expr;
-}
-
-static Node *equality(Parse *p) {
-	let expr = comparison(p);
+/* Binary operators are parsed by precedence climbing. An operator binds when
+ * its precedence is at least min_prec, and its right side is parsed one level
+ * up, so every operator is left associative. A whole operand and the operators
+ * around it are resolved in one loop instead of a call per precedence level. */
+typedef enum : u8 {
+	PREC_NONE = 0, // not a binary operator
+	PREC_RANGE,
+	PREC_LOGIC,
+	PREC_EQUALITY,
+	PREC_COMPARISON,
+	PREC_BITWISE,
+	PREC_SUM,
+	PREC_FACTOR,
+} Precedence;
+
+static const Precedence BINARY_PREC[UINT8_MAX + 1] = {
+	[DB_DOTDOT]    = PREC_RANGE,
+	[DB_AND]       = PREC_LOGIC,
+	[DB_OR]        = PREC_LOGIC,
+	[DB_IS]        = PREC_EQUALITY,
+	[DB_LESS]      = PREC_COMPARISON,
+	[DB_LESSEQ]    = PREC_COMPARISON,
+	[DB_GREATER]   = PREC_COMPARISON,
+	[DB_GREATEREQ] = PREC_COMPARISON,
+	[DB_BITOR]     = PREC_BITWISE,
+	[DB_AMPER]     = PREC_BITWISE,
+	[DB_PLUS]      = PREC_SUM,
+	[DB_MINUS]     = PREC_SUM,
+	[DB_STAR]      = PREC_FACTOR,
+	[DB_SLASH]     = PREC_FACTOR,
+};
 
-	while (match(p, DB_IS)) {
-		Node *left   = expr;
-		bool  is_not = match(p, DB_NOT);
+static Node *binary(Parse *p, Precedence min_prec) {
+	let expr = unary(p);
 
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = is_not ? DB_NOT : DB_IS,
-				.expra    = left,
-				.exprb    = comparison(p),
-			},
-		});
-	}
+	loop {
+		const int        tok  = peek(p);
+		const Precedence prec = tok < 0 ? PREC_NONE : BINARY_PREC[tok];
+		if (prec == PREC_NONE || prec < min_prec) return expr;
 
-	return expr;
-}
+		p->position++;
 
-static Node *comparison(Parse *p) {
-	let expr = bit_wise(p);
+		// 'is not' is one operator
+		u8 operator = tok;
+		if (tok == DB_IS && match(p, DB_NOT)) operator = DB_NOT;
 
-	// call peek(p) for some weird C optimization reason
-	int tok = peek(p);
-	while (tok == DB_LESS
-			|| tok == DB_LESSEQ
-			|| tok == DB_GREATER
-			|| tok == DB_GREATEREQ)
-	{
 		let left = expr;
 		expr = append_node(p, &(Node) {
 			.tag   = EX_BINOP,
 			.binop = {
-				.operator = advance(p)->token,
+				.operator = operator,
 				.expra    = left,
-				.exprb    = bit_wise(p),
+				.exprb    = binary(p, prec + 1),
 			},
 		});
 
-		tok = peek(p);
-	}
-
-	return expr;
-}
-
-static Node *bit_wise(Parse *p) {
-	let expr = sum(p);
-
-	while (peek(p) == DB_BITOR || peek(p) == DB_AMPER) {
-		let left = expr;
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = advance(p)->token,
-				.expra    = left,
-				.exprb    = sum(p),
-			},
-		});
+		// ranges don't chain, a..b..c stops after a..b
+		if (tok == DB_DOTDOT) min_prec = prec + 1;
 	}
-
-	return expr;
 }
 
-static Node *sum(Parse *p) {
-	let expr = factor(p);
-
-	while (peek(p) == DB_PLUS || peek(p) == DB_MINUS) {
-		let left = expr;
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = advance(p)->token,
-				.expra    = left,
-				.exprb    = factor(p),
-			},
-		});
-	}
-
-	return expr;
+static inline Node *expression(Parse *p) {
+	return binary(p, PREC_RANGE);
 }
 
-static Node *factor(Parse *p) {
-	let expr = unary(p);
-
-	while (peek(p) == DB_STAR || peek(p) == DB_SLASH) {
-		let left = expr;
-		expr = append_node(p, &(Node) {
-			.tag   = EX_BINOP,
-			.binop = {
-				.operator = advance(p)->token,
-				.expra    = left,
-				.exprb    = unary(p),
-			},
-		});
-	}
-
-	return expr;
+// anything that can't be a range, like conditions
+static inline Node *logic(Parse *p) {
+	return binary(p, PREC_LOGIC);
 }
 
 static Node *unary(Parse *p) {
@@ -793,7 +1270,7 @@ static Node *unary(Parse *p) {
 			return append_node(p, &(Node) {
 				.tag = EX_UNARY,
 				.unary = {
-					.operator = advance(p)->token,
+					.operator = advance(p).token,
 					.expr     = unary(p),
 				},
 			});
@@ -808,26 +1285,26 @@ static Node *call(Parse *p) {
 
 	loop {
 		if (match(p, DB_LPAREN)) {
-			size_t cap = 3;
-			Call call = {
-				.caller = expr,
-				.params = make(Node *, cap),
-				.len    = 0,
-			};
+			const size_t base = p->scratch.len;
 
 			for_range (i, 127) {
 				let param = expression(p);
 				if (param == NULL) break;
 
-				EXTEND_ARR(Node *, call.params, call.len, cap);
-				call.params[call.len++] = param;
+				push_child(p, param);
 
 				if (!match(p, DB_COMMA) || peek(p) == DB_RPAREN) break;
 			}
 
+			Call call = {
+				.caller = expr,
+				.len    = p->scratch.len - base,
+			};
+			call.params = commit_children(p, base);
+
 			if (call.len >= 127) {
-				error_file("function call may only contain 127 arguments",
-						peekline(p), p->buffer);
+				error_at("function call may only contain 127 arguments",
+						p->lines, peek_offset(p));
 			}
 
 			expect(p, DB_RPAREN, "function call must have a closing ')'");
@@ -839,14 +1316,14 @@ static Node *call(Parse *p) {
 		}
 
 		else if (match(p, DB_DOT)) {
-			DoobleToken *token = consume(p, DB_IDENT, "expected identifier");
-			if (token == NULL) return NULL;
+			DoobleToken token;
+			if (!consume(p, DB_IDENT, &token, "expected identifier")) return NULL;
 
 			expr = append_node(p, &(Node) {
 				.tag    = EX_SUBMEMBER,
 				.member = {
 					.expr = expr,
-					.name = copy_str(&token->str),
+					.name = token.ident,
 				},
 			});
 		}
@@ -856,29 +1333,30 @@ static Node *call(Parse *p) {
 }
 
 static Arguments arguments(Parse *p) {
-	Arguments args = {
-		.arr = malloc(3),
-		.len = 0,
-		.cap = 3,
-	};
+	const size_t base = p->scratch.len;
 
 	for (int i = 0; true; i++) {
 		if (i > 127) {
 			p->parse_error = true;
-			error_file("function may only contain 127 arguments",
-					peekline(p), p->buffer);
+			error_at("function may only contain 127 arguments",
+					p->lines, peek_offset(p));
 			break;
 		}
 
 		Node *arg = declaration(p);
 		if (arg == NULL) break;
 
-		EXTEND_ARR(Node *, args.arr, args.len, args.cap);
-		args.arr[args.len++] = arg;
+		push_child(p, arg);
 
 		if (!match(p, DB_COMMA)) break;
 	}
 
+	Arguments args = {
+		.len = p->scratch.len - base,
+		.cap = p->scratch.len - base,
+	};
+	args.arr = commit_children(p, base);
+
 	return args;
 }
 
@@ -890,40 +1368,33 @@ static Node *atom(Parse *p) {
 	// I have some ideas, currently recorded in my CodeWars notepad that could achieve
 	// this without a *great* sacrifice to performance.
 	if (match(p, DB_LPAREN)) {
-		i16  lparen_count = 0;
-		bool is_function  = false;
-
-		for (int i = p->position; i < p->tokens.len - 1; i++) {
-			if (p->tokens.arr[i].token == DB_RPAREN && lparen_count == 0) {
-				const u8 after_paren = p->tokens.arr[i + 1].token;
-				
-				is_function = after_paren == DB_LBRACE || after_paren == DB_ARROW;
-				break;
-			}
-
-			else if (p->tokens.arr[i].token == DB_LPAREN) lparen_count++;
-			else if (p->tokens.arr[i].token == DB_RPAREN) lparen_count--;
+		bool is_function = false;
+
+		// the token stream pairs brackets as they come in, so this only pulls
+		// tokens up to the closer once, nested parens find theirs already
+		// matched. The window keeps everything from the '(' on.
+		const size_t open = p->position - 1;
+		while (p->tokens.match[open & p->tokens.mask] == NO_MATCH
+				&& fill_window(p, p->tokens.len)) {}
+
+		const u32 close = p->tokens.match[open & p->tokens.mask];
+		if (close != NO_MATCH && fill_window(p, close + 1)) {
+			const u8 after_paren = p->tokens.kinds[(close + 1) & p->tokens.mask];
+			is_function = after_paren == DB_LBRACE || after_paren == DB_ARROW;
 		}
 
 		if (is_function) {
 			Function fn = {0};
 			fn.args = arguments(p);
-
-			if (fn.args.len == 0) {
-				free(fn.args.arr);
-				fn.args.arr = NULL;
-				fn.args.cap = 0;
-			}
-
 			expect(p, DB_RPAREN, "missing ')' at end of argument list");
 
 			if (match(p, DB_ARROW)) {
-				fn.ret_type = parse_type(NULL);
+				fn.ret_type = parse_type(p);
 			}
 
 			if (peek(p) != DB_LBRACE) {
-				error_file("expected '{' after function signature",
-						peekline(p), p->buffer);
+				error_at("expected '{' after function signature",
+						p->lines, peek_offset(p));
 				return NULL;
 			}
 
@@ -942,18 +1413,20 @@ static Node *atom(Parse *p) {
 		}
 	}
 
-	DoobleToken *tok = advance(p);
-	Literal      lit = {0};
+	if (!fill_window(p, p->position)) return NULL;
+
+	DoobleToken tok = advance(p);
+	Literal     lit = {0};
 
 	// NOTE: I might be able to clean this up a bit
-	switch (tok->token) {
+	switch (tok.token) {
 		case DB_NUM:
 			lit.tag  = LIT_NUM;
-			lit.numi = tok->vali;
+			lit.numi = tok.vali;
 			break;
 		case DB_FLOAT:
 			lit.tag  = LIT_FLT;
-			lit.numf = tok->valf;
+			lit.numf = tok.valf;
 			break;
 		case DB_NIL:
 			lit.tag = LIT_NIL;
@@ -968,11 +1441,11 @@ static Node *atom(Parse *p) {
 			break;
 		case DB_STR:
 			lit.tag = LIT_STR;
-			lit.str = copy_str(&tok->str);
+			lit.str = span_str(p, &tok);
 			break;
 		case DB_IDENT:
-			lit.tag = LIT_IDENT;
-			lit.str = copy_str(&tok->str);
+			lit.tag   = LIT_IDENT;
+			lit.ident = tok.ident;
 			break;
 		default:
 			p->position--;
@@ -985,42 +1458,13 @@ static Node *atom(Parse *p) {
 	});
 }
 
-void free_ast(size_t N, Node pool[N]) {
-	for_range (i, N) {
-		switch (pool[i].tag) {
-			case EX_FOREACH:
-			case EX_DOEACH:
-			case EX_DONTEACH:
-				freestr(&pool[i].foreach.ident);
-				break;
-
-			case EX_BLOCK:
-				free(pool[i].block.arr); // assumes that the dynamic array is in
-										 // the heap instead of a pool allocator.
-				break;
-			case EX_DECL:
-				freestr(&pool[i].declare.name);
-				break;
-			case EX_CALL:
-				free(pool[i].call.params); // again, might need a refactor if I use
-										   // a pool in the future.
-				break;
-			case EX_SUBMEMBER:
-				freestr(&pool[i].member.name);
-				break;
-			case EX_FUNCTION:
-				free(pool[i].function.args.arr); // pool again
-				break;
-			case EX_LITERAL:
-				if (pool[i].literal.tag == LIT_STR) {
-					freestr(&pool[i].literal.str);
-				}
-				break;
-
-			default:
-				break;
-		}
-	}
+// everything the AST points to lives in its arena
+void free_ast(AstResult *ast) {
+	free_arena(&ast->arena);
 
-	free(pool);
+	ast->pool      = NULL;
+	ast->pool_size = 0;
+	ast->bounds    = NULL;
+	ast->decls     = NULL;
+	ast->ndecls    = 0;
 }
@@ -9,7 +9,8 @@
 
 // hi: *Hi -> 'Hi' is a type on the tree
 
-typedef size_t SymbolHash;
+// interned symbols are already unique integers, so they are used as their own hash
+typedef Symbol SymbolHash;
 
 // NOTE: docs is the inspiration for this data structure, but should be updated
 
@@ -20,18 +20,22 @@ typedef VEC(SymbolHash) TopologicalOrder;
 // if A :: 0, B :: D, then D also gets added to the list
 typedef struct {
 	// general symbol information
-	const char *name_ref; // string reference (does not free)
-	typeid      type;
-	Node       *rvalue; // ref
+	Symbol  name;
+	typeid  type;
+	Node   *rvalue; // ref
 
 	// info for sorting
 	bool visited;           // if the node has been visited at all
 	bool active_visitation; // if the node is currently in the dfs stack
 	u32  parent_count;
 
-	VEC(SymbolHash) symbols; // links to the hash of strings (dependencies)
+	VEC(SymbolHash) symbols; // links to the symbols of dependencies
 } SymbolInfo;
 
+static size_t hash_symbol(Symbol *sym) {
+	return *sym;
+}
+
 static void free_symbolinfo(SymbolInfo *s) {
 	if (s->symbols.cap != 0) {
 		free(s->symbols.arr);
@@ -59,27 +63,27 @@ Semantics init_semantics(void) {
 			.cap = 10,
 		},
 		.all_types    = init_TypeTree(),
-		.symbol_table = BUILD_MAP(SymbolInfo, hash_str, free_symbolinfo),
+		.symbol_table = BUILD_MAP(SymbolInfo, hash_symbol, free_symbolinfo),
 		.symbol_stack = symbol_stack,
 	};
 }
 
-static void add_symbol_dep(HashMap *symbols, SymbolInfo *symbol_info, string_t *dep) {
-	SymbolInfo *s = GET_PAIR(SymbolInfo, symbols, dep->str);
+static void add_symbol_dep(HashMap *symbols, SymbolInfo *symbol_info, Symbol dep) {
+	SymbolInfo *s = GET_PAIRH(SymbolInfo, symbols, dep);
 
 	if (s == NULL) {
-		set_pair(symbols, dep->str, &(SymbolInfo) {0});
-		s = GET_PAIR(SymbolInfo, symbols, dep->str);
+		set_pair(symbols, &dep, &(SymbolInfo) { .name = dep });
+		s = GET_PAIRH(SymbolInfo, symbols, dep);
 	}
 
 	if (s->symbols.cap == 0) {
-		s->symbols.arr = make(size_t, 3);
+		s->symbols.arr = make(SymbolHash, 3);
 		s->symbols.len = 0;
 		s->symbols.cap = 3;
 	}
 
-	EXTEND_ARR(size_t, s->symbols.arr, s->symbols.len, s->symbols.cap);
-	s->symbols.arr[s->symbols.len++] = symbols->hashfn(dep->str);
+	EXTEND_ARR(SymbolHash, s->symbols.arr, s->symbols.len, s->symbols.cap);
+	s->symbols.arr[s->symbols.len++] = dep;
 
 	symbol_info->parent_count++;
 }
@@ -109,7 +113,7 @@ static void visit_symbol_deps(HashMap *symbols, SymbolInfo *symbol_info, Node *n
 			break;
 		case EX_LITERAL:
 			if (n->literal.tag == LIT_IDENT) {
-				add_symbol_dep(symbols, symbol_info, &n->literal.str);
+				add_symbol_dep(symbols, symbol_info, n->literal.ident);
 			}
 			break;
 
@@ -134,7 +138,7 @@ static void add_symbols(Semantics *s, Node *block) {
 
 		SymbolInfo symbol_info = {
 			.type     = block_ref->arr[i]->declare.type,
-			.name_ref = block_ref->arr[i]->declare.name.str,
+			.name     = block_ref->arr[i]->declare.name,
 			.rvalue   = block_ref->arr[i]->declare.assign,
 
 			.visited      = false,
@@ -148,7 +152,7 @@ static void add_symbols(Semantics *s, Node *block) {
 
 		visit_symbol_deps(&s->symbol_table, &symbol_info, block_ref->arr[i]);
 		set_pair(&s->symbol_table,
-				block_ref->arr[i]->declare.name.str,
+				&block_ref->arr[i]->declare.name,
 				&symbol_info);
 	}
 }
@@ -172,10 +176,9 @@ void add_semantic_info(Semantics *semantics, AstResult *result) {
 			semantics->ast_blocks.len,
 			semantics->ast_blocks.cap);
 
-	// add the first element of the pool (result->pool == &result->pool[0])
-	add_symbols(semantics, &result->pool[0]);
+	// the AST is borrowed, the caller frees it once the semantic pass is done
+	add_symbols(semantics, result->pool);
 	semantics->ast_blocks.arr[semantics->ast_blocks.len++] = result->pool;
-	free(result->pool);
 }
 
 static bool topo_DFS_util(HashMap *symbols, SymbolInfo *s, TopologicalOrder *order);
@@ -236,7 +239,7 @@ static bool topo_DFS_util(HashMap *symbols, SymbolInfo *info, TopologicalOrder *
 
 		if (child->active_visitation) {
 			error("circular variable dependency: %s referenced in %s",
-					info->name_ref, child->name_ref);
+					symbol_str(info->name), symbol_str(child->name));
 
 			// need to reset visited before cross edges
 			return false;
@@ -435,12 +438,13 @@ static typeid resolve_fntype(Function *func, Semantics *semantics) {
 		fn.fn.arr[fn.fn.len++] = resolve_type(func->args.arr[i], semantics);
 	}
 
-	return get_leaf(&semantics->all_types, NULL, &fn);
+	return get_leaf(&semantics->all_types, VOID_ID, &fn);
 }
 
+// aliases compare as the type they stand for
 static typeid resolve_binop(BinOp *bin, Semantics *semantics) {
-	typeid type_a = resolve_type(bin->expra, semantics);
-	typeid type_b = resolve_type(bin->exprb, semantics);
+	typeid type_a = canonical_type(&semantics->all_types, resolve_type(bin->expra, semantics));
+	typeid type_b = canonical_type(&semantics->all_types, resolve_type(bin->exprb, semantics));
 
 	switch (bin->operator) {
 		// boolean
@@ -498,7 +502,7 @@ static typeid resolve_binop(BinOp *bin, Semantics *semantics) {
 }
 
 static typeid resolve_unary(Unary *unary, Semantics *semantics) {
-	typeid type = resolve_type(unary->expr, semantics);
+	typeid type = canonical_type(&semantics->all_types, resolve_type(unary->expr, semantics));
 
 	switch (unary->operator) {
 		case DB_NOT:
@@ -556,11 +560,8 @@ static typeid resolve_type(Node *expr, Semantics *semantics) {
 
 		case EX_LITERAL:
 			if (expr->literal.tag == LIT_IDENT) {
-				char      *str        = expr->literal.str.str;
-				size_t     size       = expr->literal.str.size;
-				SymbolHash ident_hash = hash_str(str, size);
-
-				return get_scoped_symbol_type(&semantics->symbol_stack, ident_hash);
+				return get_scoped_symbol_type(&semantics->symbol_stack,
+						expr->literal.ident);
 			}
 
 			else return basic_type(&semantics->all_types,
@@ -603,7 +604,7 @@ void semantic_pass(Semantics *semantics) {
 		if (symbol->type == VOID_ID) {
 			typeid type = resolve_type(symbol->rvalue, semantics);
 			if (type == VOID_ID) {
-				error("symbol %s cannot have a type of 'void'", symbol->name_ref);
+				error("symbol %s cannot have a type of 'void'", symbol_str(symbol->name));
 				continue;
 			}
 
@@ -671,9 +672,8 @@ static bool verify_types(Semantics *semantics, Node *expr) {
 		{
 			Declaration *decl = &expr->declare;
 			typeid       type = resolve_type(decl->assign, semantics);
-			SymbolHash   hash = hash_str(decl->name.str, decl->name.size);
 
-			insert_symbol(&semantics->symbol_stack, hash, type);
+			insert_symbol(&semantics->symbol_stack, decl->name, type);
 			return verify_types(semantics, decl->assign);
 		}
 
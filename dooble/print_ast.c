@@ -1,5 +1,6 @@
 #include "internal.h"
 #include <stdio.h>
+#include <string.h>
 
 static int indent_level = 0;
 
@@ -27,14 +28,54 @@ static void print_if(IfStmt *i) {
 	printf(")\n");
 }
 
+static const char *loop_str(u8 type) {
+	return
+		type == EX_FOREACH || type == EX_FORWHILE ? "for" :
+		type == EX_DOEACH  || type == EX_DOWHILE  ? "do"  :
+		"don't";
+}
+
+static const char *binop_str(u8 operator) {
+	return
+		operator == DB_STAR      ? "*"      :
+		operator == DB_SLASH     ? "/"      :
+		operator == DB_PLUS      ? "+"      :
+		operator == DB_MINUS     ? "-"      :
+		operator == DB_AMPER     ? "&"      :
+		operator == DB_BITOR     ? "|"      :
+		operator == DB_LESS      ? "<"      :
+		operator == DB_LESSEQ    ? "<="     :
+		operator == DB_GREATER   ? ">"      :
+		operator == DB_GREATEREQ ? ">="     :
+		operator == DB_IS        ? "is"     :
+		operator == DB_NOT       ? "is not" :
+		operator == DB_AND       ? "and"    :
+		operator == DB_OR        ? "or"     :
+		operator == DB_DOTDOT    ? ".."     :
+		operator == DB_DOT       ? "."      :
+		"invalid";
+}
+
+static const char *unary_str(u8 operator) {
+	return
+		operator == DB_MINUS ? "-"   :
+		operator == DB_NOT   ? "not" :
+		operator == DB_STAR  ? "*"   :
+		operator == DB_AMPER ? "&"   :
+		"invalid";
+}
+
+static void close_node(void) {
+	indent_level--;
+	indent();
+	printf(")\n");
+}
+
 static void print_foreach(ForEach *f, u8 type) {
 	printf("(%s %s%s in\n",
-			type == EX_FOREACH ? "for" :
-			type == EX_DOEACH  ? "do"  :
-			"don't",
-
+			loop_str(type),
 			f->by_reference ? "&" : "",
-			f->ident.str);
+			symbol_str(f->ident));
 
 	indent_level++;
 
@@ -47,11 +88,7 @@ static void print_foreach(ForEach *f, u8 type) {
 }
 
 static void print_forwhile(ForWhile *f, u8 type) {
-	printf("(%s while\n",
-			type == EX_FOREACH ? "for" :
-			type == EX_DOEACH  ? "do"  :
-			"don't");
-
+	printf("(%s while\n", loop_str(type));
 
 	indent_level++;
 
@@ -86,7 +123,7 @@ static void print_block(Block *b) {
 // TypeAlias2 :: TypeAlias   -- pass 2
 
 static void print_decl(Declaration *d) {
-	printf("(%s %s\n", d->is_const ? "::" : ":=", d->name.str);
+	printf("(%s %s\n", d->is_const ? "::" : ":=", symbol_str(d->name));
 	indent_level++;
 
 	if (d->quals.is_static)  { indent(); printf("static\n");  }
@@ -96,9 +133,9 @@ static void print_decl(Declaration *d) {
 	if (d->quals.is_final)   { indent(); printf("final\n");   }
 
 	indent();
-	printf("type: %p\n", d->type);
+	printf("type: %u\n", d->type);
 
-	print_ast(d->assign);
+	if (d->assign != NULL) print_ast(d->assign);
 
 	indent_level--;
 	indent();
@@ -106,26 +143,7 @@ static void print_decl(Declaration *d) {
 }
 
 static void print_binop(BinOp *b) {
-	const char *op = 
-		b->operator == DB_STAR      ? "*"      :
-		b->operator == DB_SLASH     ? "/"      :
-		b->operator == DB_PLUS      ? "+"      :
-		b->operator == DB_MINUS     ? "-"      :
-		b->operator == DB_AMPER     ? "&"      :
-		b->operator == DB_BITOR     ? "|"      :
-		b->operator == DB_LESS      ? "<"      :
-		b->operator == DB_LESSEQ    ? "<="     :
-		b->operator == DB_GREATER   ? ">"      :
-		b->operator == DB_GREATEREQ ? ">="     :
-		b->operator == DB_IS        ? "is"     :
-		b->operator == DB_NOT       ? "is not" :
-		b->operator == DB_AND       ? "and"    :
-		b->operator == DB_OR        ? "or"     :
-		b->operator == DB_DOTDOT    ? ".."     :
-		b->operator == DB_DOT       ? "."      :
-		"invalid";
-
-	printf("(binop: %s\n", op);
+	printf("(binop: %s\n", binop_str(b->operator));
 	indent_level++;
 	print_ast(b->expra);
 	print_ast(b->exprb);
@@ -135,14 +153,7 @@ static void print_binop(BinOp *b) {
 }
 
 static void print_unary(Unary *u) {
-	const char *op =
-		u->operator == DB_MINUS ? "-"   :
-		u->operator == DB_NOT   ? "not" :
-		u->operator == DB_STAR  ? "*"   :
-		u->operator == DB_AMPER ? "&"   :
-		"invalid";
-
-	printf("(unary: %s\n", op);
+	printf("(unary: %s\n", unary_str(u->operator));
 	indent_level++;
 	print_ast(u->expr);
 	indent_level--;
@@ -168,7 +179,7 @@ static void print_call(Call *c) {
 }
 
 static void print_submember(SubMember *s) {
-	printf("(.%s\n", s->name.str);
+	printf("(.%s\n", symbol_str(s->name));
 
 	indent_level++;
 	print_ast(s->expr);
@@ -178,7 +189,7 @@ static void print_submember(SubMember *s) {
 }
 
 static void print_function(Function *f) {
-	printf("(fn() -> 0x%p\n", f->ret_type);
+	printf("(fn() -> %u\n", f->ret_type);
 
 	indent_level++;
 	for_range (i, f->args.len) {
@@ -210,7 +221,7 @@ static void print_literal(Literal *l) {
 			printf("'%s'", l->str.str);
 			break;
 		case LIT_IDENT:
-			printf("%s", l->str.str);
+			printf("%s", symbol_str(l->ident));
 			break;
 		case LIT_NIL:
 			printf("nil");
@@ -267,6 +278,190 @@ void print_ast(Node *node) {
 	}
 }
 
+// ====================================================
+// ============== Compact AST Printing ================
+// ====================================================
+
+// prints the same tree as print_ast, walking forward through the arrays
+
+static void print_compact_child(const CompactAst *ast, NodeIndex node) {
+	if (node != NO_NODE) print_compact_ast(ast, node);
+}
+
+static void print_compact_list(const CompactAst *ast, u32 extra, u32 len) {
+	for_range (i, len) {
+		print_compact_child(ast, ast->extra.arr[extra + i]);
+	}
+}
+
+static void print_compact_literal(const CompactAst *ast, NodeIndex node) {
+	const NodeData data = ast->data[node];
+	const u64      bits = (u64) data.rhs << 32 | data.lhs;
+
+	switch (ast->flags[node]) {
+		case LIT_NUM:
+			printf("%jd", (intmax_t) bits);
+			break;
+		case LIT_FLT: {
+			double numf;
+			memcpy(&numf, &bits, sizeof(numf));
+			printf("%f", numf);
+			break;
+		}
+		case LIT_BOOL:
+			printf(data.lhs ? "true" : "false");
+			break;
+		case LIT_STR:
+			printf("'%.*s'", (int) data.rhs, &ast->text.arr[data.lhs]);
+			break;
+		case LIT_IDENT:
+			printf("%s", symbol_str(compact_symbol(ast, data.lhs)));
+			break;
+		case LIT_NIL:
+			printf("nil");
+			break;
+	}
+
+	putchar('\n');
+}
+
+void print_compact_ast(const CompactAst *ast, NodeIndex node) {
+	const u8       tag   = ast->tags[node];
+	const u8       flags = ast->flags[node];
+	const NodeData data  = ast->data[node];
+	const u32     *extra = ast->extra.arr;
+
+	indent();
+
+	switch (tag) {
+		case EX_PASS:
+			printf("...");
+			break;
+
+		case EX_IF:
+			printf("(if\n");
+			indent_level++;
+
+			print_compact_child(ast, data.lhs);
+			print_compact_child(ast, extra[data.rhs]);
+
+			if (extra[data.rhs + 1] != NO_NODE) {
+				indent();
+				printf("else: \n");
+				print_compact_child(ast, extra[data.rhs + 1]);
+			}
+
+			close_node();
+			break;
+
+		case EX_FOREACH:
+		case EX_DOEACH:
+		case EX_DONTEACH:
+			printf("(%s %s%s in\n",
+					loop_str(tag),
+					flags ? "&" : "",
+					symbol_str(compact_symbol(ast, extra[data.lhs])));
+
+			indent_level++;
+			print_compact_child(ast, extra[data.lhs + 1]);
+			print_compact_child(ast, data.rhs);
+			close_node();
+			break;
+
+		case EX_FORWHILE:
+		case EX_DOWHILE:
+		case EX_DONTWHILE:
+			printf("(%s while\n", loop_str(tag));
+
+			indent_level++;
+			print_compact_child(ast, data.lhs);
+			print_compact_child(ast, data.rhs);
+			close_node();
+			break;
+
+		case EX_BLOCK:
+			printf("({}\n");
+
+			indent_level++;
+			print_compact_list(ast, data.lhs, data.rhs);
+			close_node();
+			break;
+
+		case EX_DECL:
+			printf("(%s %s\n",
+					flags & DECL_CONST ? "::" : ":=",
+					symbol_str(compact_symbol(ast, extra[data.lhs])));
+			indent_level++;
+
+			if (flags & DECL_STATIC)  { indent(); printf("static\n");  }
+			if (flags & DECL_PUB)     { indent(); printf("pub\n");     }
+			if (flags & DECL_CO)      { indent(); printf("co\n");      }
+			if (flags & DECL_PROTECT) { indent(); printf("protect\n"); }
+			if (flags & DECL_FINAL)   { indent(); printf("final\n");   }
+
+			indent();
+			printf("type: %u\n", ast->types.arr[extra[data.lhs + 1]]);
+
+			print_compact_child(ast, data.rhs);
+			close_node();
+			break;
+
+		case EX_BINOP:
+			printf("(binop: %s\n", binop_str(flags));
+
+			indent_level++;
+			print_compact_child(ast, data.lhs);
+			print_compact_child(ast, data.rhs);
+			close_node();
+			break;
+
+		case EX_UNARY:
+			printf("(unary: %s\n", unary_str(flags));
+
+			indent_level++;
+			print_compact_child(ast, data.lhs);
+			close_node();
+			break;
+
+		case EX_CALL:
+			printf("(call()\n");
+			indent_level++;
+			print_compact_child(ast, data.lhs);
+
+			indent();
+			printf("args:\n");
+
+			print_compact_list(ast, data.rhs + 1, extra[data.rhs]);
+			close_node();
+			break;
+
+		case EX_SUBMEMBER:
+			printf("(.%s\n", symbol_str(compact_symbol(ast, data.rhs)));
+
+			indent_level++;
+			print_compact_child(ast, data.lhs);
+			close_node();
+			break;
+
+		case EX_FUNCTION:
+			printf("(fn() -> %u\n", ast->types.arr[extra[data.rhs]]);
+
+			indent_level++;
+			print_compact_list(ast, data.rhs + 2, extra[data.rhs + 1]);
+
+			indent();
+			printf("body:\n");
+
+			print_compact_child(ast, data.lhs);
+			close_node();
+			break;
+
+		case EX_LITERAL:
+			print_compact_literal(ast, node);
+			break;
+	}
+}
+
 // ====================================================
 // ================= Type Printing ====================
 // ====================================================
@@ -0,0 +1,216 @@
+#include "internal.h"
+
+/* Character class scanning for the lexer.
+ *
+ * Each scanner starts at `pos` and returns the index of the first byte that ends
+ * the run it is looking for, or `len` if the buffer runs out first. The vector
+ * versions classify 16 (SSE2) or 32 (AVX2) bytes per step and only fall back to
+ * the scalar loop for the tail of the buffer, so they never read past `len`.
+ *
+ * All classes are plain ascii. isalnum and friends depend on the locale, which
+ * is not something the language should. */
+
+static inline bool is_blank(char ch) {
+	return ch == ' ' || ch == '\t';
+}
+
+static inline bool is_ident(char ch) {
+	return (ch >= 'a' && ch <= 'z')
+		|| (ch >= 'A' && ch <= 'Z')
+		|| (ch >= '0' && ch <= '9')
+		|| ch == '_';
+}
+
+static u32 skip_blank_scalar(const char *buf, u32 pos, u32 len) {
+	while (pos < len && is_blank(buf[pos])) pos++;
+	return pos;
+}
+
+static u32 skip_ident_scalar(const char *buf, u32 pos, u32 len) {
+	while (pos < len && is_ident(buf[pos])) pos++;
+	return pos;
+}
+
+static u32 find_newline_scalar(const char *buf, u32 pos, u32 len) {
+	while (pos < len && buf[pos] != '\n') pos++;
+	return pos;
+}
+
+static u32 find_quote_scalar(const char *buf, u32 pos, u32 len) {
+	while (pos < len && buf[pos] != '\'' && buf[pos] != '\n') pos++;
+	return pos;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	define SCAN_X86
+#	include <immintrin.h>
+#endif
+
+#ifdef SCAN_X86
+
+/* Signed byte compares are the only ones SSE2 has, so ranges are checked by
+ * shifting the low end of the range down to -128 and comparing against the
+ * shifted high end. Bytes >= 0x80 never land inside any of these ranges. */
+#define IN_RANGE_SSE2(v, lo, hi) \
+	_mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char) (0x80 - (lo)))), \
+			_mm_set1_epi8((char) (0x80 + (hi) - (lo) + 1)))
+
+static inline __m128i blank_sse2(__m128i v) {
+	return _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+}
+
+static inline __m128i ident_sse2(__m128i v) {
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i alpha = IN_RANGE_SSE2(lower, 'a', 'z');
+	__m128i digit = IN_RANGE_SSE2(v, '0', '9');
+	__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+
+	return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static inline __m128i quote_sse2(__m128i v) {
+	return _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+// `in_class` is the mask of bytes that continue the run
+#define SCAN_SSE2(buf, pos, len, in_class)                                  \
+	do {                                                                    \
+		while (pos + 16 <= len) {                                           \
+			__m128i v    = _mm_loadu_si128((const __m128i *) &buf[pos]);    \
+			u32     stop = ~_mm_movemask_epi8(in_class) & 0xFFFF;           \
+			if (stop != 0) return pos + __builtin_ctz(stop);                \
+			pos += 16;                                                      \
+		}                                                                   \
+	} while (0)
+
+static u32 skip_blank_sse2(const char *buf, u32 pos, u32 len) {
+	SCAN_SSE2(buf, pos, len, blank_sse2(v));
+	return skip_blank_scalar(buf, pos, len);
+}
+
+static u32 skip_ident_sse2(const char *buf, u32 pos, u32 len) {
+	SCAN_SSE2(buf, pos, len, ident_sse2(v));
+	return skip_ident_scalar(buf, pos, len);
+}
+
+static u32 find_newline_sse2(const char *buf, u32 pos, u32 len) {
+	SCAN_SSE2(buf, pos, len, _mm_xor_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_set1_epi8(-1)));
+	return find_newline_scalar(buf, pos, len);
+}
+
+static u32 find_quote_sse2(const char *buf, u32 pos, u32 len) {
+	SCAN_SSE2(buf, pos, len, _mm_xor_si128(quote_sse2(v), _mm_set1_epi8(-1)));
+	return find_quote_scalar(buf, pos, len);
+}
+
+// AVX2 only has a signed greater than, so the range check is flipped around
+#define IN_RANGE_AVX2(v, lo, hi)                                   \
+	_mm256_cmpgt_epi8(                                             \
+			_mm256_set1_epi8((char) (0x80 + (hi) - (lo) + 1)),        \
+			_mm256_add_epi8(v, _mm256_set1_epi8((char) (0x80 - (lo)))))
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define SCAN_AVX2(buf, pos, len, in_class)                                   \
+	do {                                                                     \
+		while (pos + 32 <= len) {                                            \
+			__m256i v    = _mm256_loadu_si256((const __m256i *) &buf[pos]);  \
+			u32     stop = ~(u32) _mm256_movemask_epi8(in_class);            \
+			if (stop != 0) return pos + __builtin_ctz(stop);                 \
+			pos += 32;                                                       \
+		}                                                                    \
+	} while (0)
+
+AVX2 static u32 skip_blank_avx2(const char *buf, u32 pos, u32 len) {
+	SCAN_AVX2(buf, pos, len, _mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+	return skip_blank_scalar(buf, pos, len);
+}
+
+AVX2 static inline __m256i ident_avx2(__m256i v) {
+	__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i alpha = IN_RANGE_AVX2(lower, 'a', 'z');
+	__m256i digit = IN_RANGE_AVX2(v, '0', '9');
+	__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+
+	return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+AVX2 static u32 skip_ident_avx2(const char *buf, u32 pos, u32 len) {
+	SCAN_AVX2(buf, pos, len, ident_avx2(v));
+	return skip_ident_scalar(buf, pos, len);
+}
+
+AVX2 static u32 find_newline_avx2(const char *buf, u32 pos, u32 len) {
+	SCAN_AVX2(buf, pos, len, _mm256_xor_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+				_mm256_set1_epi8(-1)));
+	return find_newline_scalar(buf, pos, len);
+}
+
+AVX2 static u32 find_quote_avx2(const char *buf, u32 pos, u32 len) {
+	SCAN_AVX2(buf, pos, len, _mm256_xor_si256(
+				_mm256_or_si256(
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+				_mm256_set1_epi8(-1)));
+	return find_quote_scalar(buf, pos, len);
+}
+
+#endif // SCAN_X86
+
+typedef u32 (*Scanner)(const char *buf, u32 pos, u32 len);
+
+// SSE2 is part of x86-64, so it is always the baseline there
+static struct {
+	Scanner skip_blank;
+	Scanner skip_ident;
+	Scanner find_newline;
+	Scanner find_quote;
+} scanners = {
+#ifdef SCAN_X86
+	.skip_blank   = skip_blank_sse2,
+	.skip_ident   = skip_ident_sse2,
+	.find_newline = find_newline_sse2,
+	.find_quote   = find_quote_sse2,
+#else
+	.skip_blank   = skip_blank_scalar,
+	.skip_ident   = skip_ident_scalar,
+	.find_newline = find_newline_scalar,
+	.find_quote   = find_quote_scalar,
+#endif
+};
+
+#ifdef SCAN_X86
+startup static void select_scanners(void) {
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2")) return;
+
+	scanners.skip_blank   = skip_blank_avx2;
+	scanners.skip_ident   = skip_ident_avx2;
+	scanners.find_newline = find_newline_avx2;
+	scanners.find_quote   = find_quote_avx2;
+}
+#endif
+
+u32 skip_blank(const char *buf, u32 pos, u32 len) {
+	return scanners.skip_blank(buf, pos, len);
+}
+
+u32 skip_ident(const char *buf, u32 pos, u32 len) {
+	return scanners.skip_ident(buf, pos, len);
+}
+
+u32 find_newline(const char *buf, u32 pos, u32 len) {
+	return scanners.find_newline(buf, pos, len);
+}
+
+u32 find_quote(const char *buf, u32 pos, u32 len) {
+	return scanners.find_quote(buf, pos, len);
+}
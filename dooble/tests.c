@@ -2,6 +2,8 @@
 #include "../utils/input.h"
 #include "../utils/utils.h"
 #include "type.h"
+#include "backend/cgen/internal.h"
+#include <threads.h>
 
 static UnitTest_t lexer_test(void) {
 	cstr buffer =
@@ -9,11 +11,10 @@ static UnitTest_t lexer_test(void) {
 		"	return a + b\n"
 		"}\n";
 
-	DoobleToken *tokens;
-	u32 len = get_tokens(buffer, &tokens);
-	ASSERT(len == 22, "lexed tokens did not meet expected length");
+	TokenStream tokens = get_tokens(buffer);
+	ASSERT(tokens.len == 22, "lexed tokens did not meet expected length");
 
-	free_tokens(len, tokens);
+	free_tokens(&tokens);
 	END_UNIT_TEST();
 }
 
@@ -24,46 +25,277 @@ static UnitTest_t lexer_num_test(void) {
 		"0xFF_00_00\t"
 		"0b101010\n";
 
-	DoobleToken *tokens;
-	u32 len = get_tokens(buffer, &tokens);
-	ASSERT(len == 6, "lexed tokens did not meet expected length");
+	TokenStream tokens = get_tokens(buffer);
+	ASSERT(tokens.len == 6, "lexed tokens did not meet expected length");
 
-	ASSERT(tokens[0].token == DB_NUM,   "token is not an integer");
-	ASSERT(tokens[1].token == DB_FLOAT, "token is not an float");
-	ASSERT(tokens[2].token == DB_NUM,   "token is not an integer");
+	ASSERT(tokens.kinds[0] == DB_NUM,   "token is not an integer");
+	ASSERT(tokens.kinds[1] == DB_FLOAT, "token is not an float");
+	ASSERT(tokens.kinds[2] == DB_NUM,   "token is not an integer");
 
-	ASSERT(tokens[0].vali == 1293342,  "number does not hold expected value");
-	ASSERT_FLT(tokens[1].valf, 12345.6, "number does not hold expected value");
-	ASSERT(tokens[2].vali == 0xFF0000, "number does not hold expected value");
-	ASSERT(tokens[3].vali == 0b101010, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 0).vali == 1293342,  "number does not hold expected value");
+	ASSERT_FLT(get_token(&tokens, 1).valf, 12345.6, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 2).vali == 0xFF0000, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 3).vali == 0b101010, "number does not hold expected value");
 
-	free_tokens(len, tokens);
+	free_tokens(&tokens);
+	END_UNIT_TEST();
+}
+
+static UnitTest_t lexer_num_edge_test(void) {
+	cstr buffer =
+		"0.5 1..5 0o17 0.1 "
+		"3.14159265358979323846264338327950288 "
+		"9223372036854775807 0xFFFF_FFFF_FFFF_FFFF\n";
+
+	TokenStream tokens = get_tokens(buffer);
+	ASSERT(tokens.len == 11, "lexed tokens did not meet expected length");
+
+	ASSERT(tokens.kinds[0] == DB_FLOAT,  "token is not a float");
+	ASSERT(tokens.kinds[2] == DB_DOTDOT, "range was lexed as a float");
+	ASSERT(tokens.kinds[5] == DB_FLOAT,  "token is not a float");
+
+	ASSERT(get_token(&tokens, 0).valf == 0.5, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 1).vali == 1,   "number does not hold expected value");
+	ASSERT(get_token(&tokens, 3).vali == 5,   "number does not hold expected value");
+	ASSERT(get_token(&tokens, 4).vali == 017, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 5).valf == 0.1, "float is not correctly rounded");
+	ASSERT(get_token(&tokens, 6).valf == 3.141592653589793, "float is not correctly rounded");
+	ASSERT(get_token(&tokens, 7).vali == INTMAX_MAX, "number does not hold expected value");
+	ASSERT(get_token(&tokens, 8).vali == -1, "hex literal does not use all 64 bits");
+
+	free_tokens(&tokens);
 	END_UNIT_TEST();
 }
 
 static UnitTest_t num_greedy_test(void) {
 	cstr buffer = "1,2\n";
 
-	DoobleToken *tokens;
-	u32 len = get_tokens(buffer, &tokens);
+	TokenStream tokens = get_tokens(buffer);
+
+	ASSERT(tokens.len == 5, "number has consumed additional token");
+
+	free_tokens(&tokens);
+	END_UNIT_TEST();
+}
+
+static UnitTest_t lexer_span_test(void) {
+	cstr buffer = "greeting :: 'hello world'\n";
+
+	TokenStream tokens = get_tokens(buffer);
+	ASSERT(tokens.len == 6, "lexed tokens did not meet expected length");
+
+	ASSERT(tokens.kinds[0] == DB_IDENT, "token is not an identifier");
+	ASSERT(tokens.kinds[3] == DB_STR,   "token is not a string");
+
+	let          tok = get_token(&tokens, 3);
+	smart_string str = token_str(buffer, &tok);
+	ASSERT_STR(symbol_str(get_token(&tokens, 0).ident), "greeting", "identifier does not match source");
+	ASSERT_STR(str.str, "hello world", "string span does not match source");
+
+	free_tokens(&tokens);
+	END_UNIT_TEST();
+}
+
+static UnitTest_t keyword_test(void) {
+	cstr buffer =
+		"alloc alias and break case co continue defer do don't else elif fall "
+		"false final for free if in is include map match nil not or package "
+		"protocol protect pub return static struct sumtype test true vec yield "
+		"allocs dont iff returns\n";
+
+	TokenStream tokens = get_tokens(buffer);
+	ASSERT(tokens.len == DB_YIELD + 7, "lexed tokens did not meet expected length");
+
+	for_range (i, DB_YIELD + 1) {
+		ASSERT(tokens.kinds[i] == i, "keyword was not recognized");
+	}
+
+	for_range (i, 4) {
+		ASSERT(tokens.kinds[DB_YIELD + 1 + i] == DB_IDENT, "identifier lexed as a keyword");
+	}
+
+	free_tokens(&tokens);
+	END_UNIT_TEST();
+}
+
+// runs long enough to cross several vector widths and leave a scalar tail
+static UnitTest_t scan_test(void) {
+	char buffer[100];
+
+	memset(buffer, ' ', sizeof(buffer));
+	buffer[70] = '\t';
+	buffer[71] = 'x';
+	ASSERT(skip_blank(buffer, 3, sizeof(buffer)) == 71, "blank run ended early");
+	ASSERT(skip_blank(buffer, 72, sizeof(buffer)) == sizeof(buffer), "blank run overran buffer");
+
+	memset(buffer, 'a', sizeof(buffer));
+	buffer[10] = 'Z';
+	buffer[33] = '_';
+	buffer[50] = '9';
+	buffer[81] = '+';
+	buffer[90] = '\x80';
+	ASSERT(skip_ident(buffer, 0, sizeof(buffer)) == 81, "identifier run ended at the wrong byte");
+	ASSERT(skip_ident(buffer, 82, sizeof(buffer)) == 90, "non ascii byte treated as identifier");
 
-	ASSERT(len == 5, "number has consumed additional token");
+	buffer[40] = '\n';
+	buffer[64] = '\'';
+	ASSERT(find_newline(buffer, 0, sizeof(buffer)) == 40, "newline was not found");
+	ASSERT(find_newline(buffer, 41, sizeof(buffer)) == sizeof(buffer), "newline search overran buffer");
+	ASSERT(find_quote(buffer, 0, sizeof(buffer)) == 40, "string did not stop at newline");
+	ASSERT(find_quote(buffer, 41, sizeof(buffer)) == 64, "closing quote was not found");
 
-	free_tokens(len, tokens);
+	END_UNIT_TEST();
+}
+
+static UnitTest_t lexer_stream_test(void) {
+	cstr buffer = "x := a..b ... c\n-- comment\ny = 'hi'\n";
+
+	TokenStream tokens = get_tokens(buffer);
+	LineTable   lines  = init_line_table(buffer, strlen(buffer));
+	Lexer       lex    = init_lexer(buffer, strlen(buffer), &lines);
+
+	const u8 expected[] = {
+		DB_IDENT, DB_COLON, DB_EQUAL, DB_IDENT, DB_DOTDOT, DB_IDENT,
+		DB_DOTDOTDOT, DB_IDENT, DB_SEMI, DB_IDENT, DB_EQUAL, DB_STR, DB_SEMI,
+		DB_EOF,
+	};
+
+	ASSERT(tokens.len == sizeof(expected), "wrong number of tokens");
+
+	for_range (i, tokens.len) {
+		let tok = next_token(&lex);
+
+		ASSERT(tokens.kinds[i] == expected[i], "unexpected token");
+		ASSERT(tok.token == tokens.kinds[i], "streamed token differs");
+		ASSERT(tok.offset == tokens.offsets[i], "streamed offset differs");
+	}
+
+	ASSERT(next_token(&lex).token == DB_EOF, "lexer did not stay at EOF");
+
+	free_tokens(&tokens);
+	free_line_table(&lines);
+	END_UNIT_TEST();
+}
+
+// a ring only keeps the last `cap` tokens, growing it must not lose any of them
+static UnitTest_t token_ring_test(void) {
+	TokenStream ring = init_token_stream(4, true);
+
+	for_range (i, 14) {
+		if (i == 10) grow_token_stream(&ring);
+
+		let tok = (DoobleToken) {
+			.token  = i % 2 ? DB_NUM : DB_COMMA,
+			.offset = i,
+			.vali   = i * 10,
+		};
+		push_token(&ring, &tok);
+	}
+
+	ASSERT(ring.cap == 8, "ring did not grow");
+
+	for (int i = 6; i < 14; i++) {
+		let tok = get_token(&ring, i);
+		ASSERT(tok.offset == i, "token moved in the ring");
+		ASSERT(tok.token != DB_NUM || tok.vali == i * 10, "value moved in the ring");
+	}
+
+	free_tokens(&ring);
+	END_UNIT_TEST();
+}
+
+static UnitTest_t bracket_match_test(void) {
+	cstr buffer = "f((a)[b], {c}) ] (";
+
+	TokenStream tokens = get_tokens(buffer);
+	const u8 expected[] = {
+		DB_IDENT, DB_LPAREN, DB_LPAREN, DB_IDENT, DB_RPAREN, DB_LSQUARE,
+		DB_IDENT, DB_RSQUARE, DB_COMMA, DB_LBRACE, DB_IDENT, DB_RBRACE,
+		DB_RPAREN, DB_RSQUARE, DB_LPAREN,
+	};
+
+	for_range (i, sizeof(expected)) {
+		ASSERT(tokens.kinds[i] == expected[i], "unexpected token");
+	}
+
+	ASSERT(tokens.match[1] == 12 && tokens.match[12] == 1, "outer parens not matched");
+	ASSERT(tokens.match[2] == 4  && tokens.match[4]  == 2, "inner parens not matched");
+	ASSERT(tokens.match[5] == 7  && tokens.match[7]  == 5, "squares not matched");
+	ASSERT(tokens.match[9] == 11 && tokens.match[11] == 9, "braces not matched");
+	ASSERT(tokens.match[13] == NO_MATCH, "stray closer was matched");
+	ASSERT(tokens.match[14] == NO_MATCH, "unclosed opener was matched");
+	ASSERT(tokens.open.len == 1 && tokens.open.arr[0].index == 14, "unclosed opener not kept");
+
+	free_tokens(&tokens);
+	END_UNIT_TEST();
+}
+
+// big enough to be split into chunks, and dense enough that some fill up
+static UnitTest_t lexer_parallel_test(void) {
+	cstr snippet =
+		"add :: (a: int, b: int) int {\n"
+		"\treturn a + b * 0x1F - 3.25\n"
+		"}\n\n\n"
+		"x := call(a,\n  b,\n  c)\r\n"
+		"-- comment 'not a string\n"
+		"s = 'hi there' ; y = s.len\n"
+		"  \n\n"
+		// halfway between two doubles until the last digit, only strtod rounds it
+		"z := 9007199254740993."
+		"00000000000000000000000000000000000000000000000000"
+		"00000000000000000000000000000000000000000000000000"
+		"00000000000000000000000000000000000000000000000001\n";
+
+	const u32 len    = strlen(snippet);
+	const u32 copies = (1 << 20) / len;
+	char     *buffer = malloc(len * copies + 1);
+
+	for_range (i, copies) memcpy(&buffer[i * len], snippet, len);
+	buffer[len * copies] = '\0';
+
+	TokenStream tokens = get_tokens(buffer);
+	LineTable   lines  = init_line_table(buffer, len * copies);
+	Lexer       lex    = init_lexer(buffer, len * copies, &lines);
+
+	for_range (i, tokens.len) {
+		let tok      = next_token(&lex);
+		let parallel = get_token(&tokens, i);
+
+		ASSERT(tok.token == parallel.token, "parallel token differs");
+		ASSERT(tok.offset == parallel.offset, "parallel offset differs");
+		ASSERT(tok.token != DB_IDENT || tok.ident == parallel.ident, "parallel symbol differs");
+		ASSERT(tok.token != DB_NUM || tok.vali == parallel.vali, "parallel value differs");
+		ASSERT(tok.token != DB_FLOAT || tok.valf == parallel.valf, "parallel float differs");
+		ASSERT(tok.token != DB_FLOAT || tok.valf == 3.25 || tok.valf == 9007199254740994.0, "long float was not rounded up");
+		ASSERT(tok.token != DB_STR || tok.span.start == parallel.span.start, "parallel span differs");
+
+		if (tok.token == DB_RPAREN || tok.token == DB_RBRACE) {
+			const u32 open = tokens.match[i];
+			ASSERT(open != NO_MATCH && tokens.match[open] == i, "brackets not matched across chunks");
+		}
+	}
+
+	ASSERT(tokens.kinds[tokens.len - 1] == DB_EOF, "parallel tokens did not end in EOF");
+	ASSERT(next_token(&lex).token == DB_EOF, "parallel lexing dropped tokens");
+
+	free_tokens(&tokens);
+	free_line_table(&lines);
+	free(buffer);
 	END_UNIT_TEST();
 }
 
 static UnitTest_t parse_call_test(void) {
 	cstr buffer = "hello_world(1,2,)(3)(4,5)(6,).hi(7,8,9)\n";
 
-	DoobleToken *tokens = NULL;
-	u32          len    = get_tokens(buffer, &tokens);
-	TypeTree     tree   = init_TypeTree();
-	AstResult    ast    = get_ast(len, tokens, &tree, buffer);
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
 
 	print_ast(ast.pool);
-	free_ast(ast.pool_size, ast.pool);
+	free_ast(&ast);
 	freetree(&tree);
+	free_line_table(&lines);
 
 	END_UNIT_TEST();
 }
@@ -71,15 +303,36 @@ static UnitTest_t parse_call_test(void) {
 static UnitTest_t parse_test(void) {
 	cstr buffer = "(1 + 2) * -3 >= 1 and hi(1, 2,)()(1, 3) is not false\n";
 
-	DoobleToken *tokens = NULL;
-	u32          len    = get_tokens(buffer, &tokens);
-	TypeTree     tree   = init_TypeTree();
-	AstResult    ast    = get_ast(len, tokens, &tree, buffer);
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
 
-	// print_tokens(len, tokens);
 	print_ast(ast.pool);
-	free_ast(ast.pool_size, ast.pool);
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// the paren scan has to look further ahead than the initial token window
+static UnitTest_t parse_lookahead_test(void) {
+	cstr buffer = "x := (1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 + 10 + 11 + 12) * 2\n"
+		"f :: (a: int, b: int, c: int, d: int, e: int, f: int) {}\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err, "parse failed");
+	ASSERT(ast.pool->block.len == 2, "expected 2 statements");
+	ASSERT(ast.pool->block.arr[1]->declare.assign->tag == EX_FUNCTION, "not parsed as a function");
+
+	free_ast(&ast);
 	freetree(&tree);
+	free_line_table(&lines);
 
 	END_UNIT_TEST();
 }
@@ -87,14 +340,901 @@ static UnitTest_t parse_test(void) {
 static UnitTest_t parse_fn(void) {
 	cstr buffer = "func :: () {}\n";
 
-	DoobleToken *tokens = NULL;
-	u32          len    = get_tokens(buffer, &tokens);
-	TypeTree     tree   = init_TypeTree();
-	AstResult    ast    = get_ast(len, tokens, &tree, buffer);
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
 
 	print_ast(ast.pool);
-	free_ast(ast.pool_size, ast.pool);
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// equal types are the same leaf, also once a branch is long enough to be hashed
+static UnitTest_t type_intern_test(void) {
+#define INTERN_TYPES 200
+	TypeTree tree = init_TypeTree();
+	typeid   named[INTERN_TYPES];
+	typeid   arrays[INTERN_TYPES];
+
+	typeid ptr = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_PTR });
+	for_range (i, INTERN_TYPES) {
+		char name[16];
+		snprintf(name, sizeof(name), "T%d", i);
+
+		named[i]  = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr(name) });
+		arrays[i] = get_leaf(&tree, ptr, &(TypeLeaf) { .tag = DBLTP_ARR, .size = i });
+	}
+
+	for_range (i, INTERN_TYPES) {
+		char name[16];
+		snprintf(name, sizeof(name), "T%d", i);
+
+		ASSERT(get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr(name) }) == named[i],
+				"named type was added twice");
+		ASSERT(get_leaf(&tree, ptr, &(TypeLeaf) { .tag = DBLTP_ARR, .size = i }) == arrays[i],
+				"array type was added twice");
+		ASSERT(i == 0 || named[i] != named[i - 1], "different names share a leaf");
+	}
+
+	ASSERT(basic_type(&tree, INT_INDEX) == get_leaf(&tree, VOID_ID, &(TypeLeaf) {
+		.tag  = DBLTP_NAME,
+		.name = intern_cstr("int"),
+	}), "builtin type was added twice");
+
+	typeid args[] = { named[1], arrays[2] };
+	TypeLeaf fn = { .tag = DBLTP_FN, .fn = { .ret = named[3], .arr = args, .len = 2 } };
+	typeid first = get_leaf(&tree, VOID_ID, &fn);
+
+	ASSERT(get_leaf(&tree, VOID_ID, &fn) == first, "function type was added twice");
+	args[1] = arrays[3];
+	ASSERT(get_leaf(&tree, VOID_ID, &fn) != first, "different function types share a leaf");
+
+	TypeLeaf ztruct = { .tag = DBLTP_STRUCT };
+	ASSERT(get_leaf(&tree, VOID_ID, &ztruct) == get_leaf(&tree, VOID_ID, &ztruct), "struct type was added twice");
+	ASSERT(leaf_exists(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr("T7") }),
+			"named type is not found");
+
+	freetree(&tree);
+	END_UNIT_TEST();
+}
+
+// struct literals with the same members are one type, declared structs stay
+// apart by name, and fingerprints cover the path
+static UnitTest_t type_fingerprint_test(void) {
+	cstr buffer =
+		"Vec2 :: struct {\n"
+		"	x: dooble\n"
+		"	y: dooble\n"
+		"}\n"
+		"Point :: struct {\n"
+		"	x: dooble\n"
+		"	y: dooble\n"
+		"}\n"
+		"Swapped :: struct {\n"
+		"	y: dooble\n"
+		"	x: dooble\n"
+		"}\n"
+		"Line :: struct {\n"
+		"	a: *struct {\n"
+		"		x: dooble\n"
+		"		y: dooble\n"
+		"	}\n"
+		"	b: *Vec2\n"
+		"	c: *struct {\n"
+		"		x: dooble\n"
+		"		y: dooble\n"
+		"	}\n"
+		"}\n"
+		"Pair :: alias struct {\n"
+		"	x: dooble\n"
+		"	y: dooble\n"
+		"}\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err, "parse failed");
+	ASSERT(tree.aliases.len == 5, "types were not declared");
+
+	const typeid vec2    = tree.aliases.arr[0].to;
+	const typeid point   = tree.aliases.arr[1].to;
+	const typeid swapped = tree.aliases.arr[2].to;
+	const TypeLeaf *line = type_leaf(&tree, tree.aliases.arr[3].to);
+	const typeid pair    = tree.aliases.arr[4].to;
+
+	ASSERT(vec2 != point, "declared structs with the same members were merged");
+	ASSERT(type_leaf(&tree, vec2)->fingerprint != type_leaf(&tree, point)->fingerprint,
+			"the declared name is not in the fingerprint");
+	ASSERT(vec2 != swapped, "structs with members in another order were merged");
+
+	// *struct {...} ends in a struct leaf of its own, under a pointer
+	const typeid anon = line->members.arr[0].type;
+	ASSERT(type_leaf(&tree, anon)->tag == DBLTP_STRUCT && anon != vec2, "anonymous struct has no leaf of its own");
+	ASSERT(type_leaf(&tree, anon)->fingerprint != type_leaf(&tree, vec2)->fingerprint,
+			"the parent is not in the fingerprint");
+	ASSERT(line->members.arr[2].type == anon, "struct literals with the same members were not merged");
+
+	// the same leaves looked up from another tree get the same fingerprints
+	TypeTree     other = init_TypeTree();
+	const typeid dbl   = get_leaf(&other, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr("dooble") });
+	Member       xy[]  = { { intern_cstr("x"), dbl }, { intern_cstr("y"), dbl } };
+	const typeid copy  = get_leaf(&other, VOID_ID, &(TypeLeaf) { .tag = DBLTP_STRUCT, .members = { xy, 2, 2 } });
+	ASSERT(type_leaf(&other, copy)->fingerprint == type_leaf(&tree, pair)->fingerprint,
+			"fingerprint depends on the tree");
+
+	// a declared struct is never the literal with the same members
+	const typeid named = get_leaf(&other, VOID_ID, &(TypeLeaf) {
+		.tag     = DBLTP_STRUCT,
+		.members = { xy, 2, 2, intern_cstr("Vec2") },
+	});
+	ASSERT(named != copy, "a declared struct and a literal share a leaf");
+	ASSERT(type_leaf(&other, named)->fingerprint == type_leaf(&tree, vec2)->fingerprint,
+			"fingerprint of a declared struct depends on the tree");
+
+	freetree(&other);
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// a type may be used before it is declared, only a second declaration is an error
+static UnitTest_t type_declare_order_test(void) {
+	const char *sources[] = {
+		// forward
+		"A :: struct {\n"
+		"	b: B\n"
+		"}\n"
+		"B :: struct {\n"
+		"	x: int\n"
+		"}\n",
+
+		// mutual
+		"Node :: struct {\n"
+		"	list: *List\n"
+		"}\n"
+		"List :: struct {\n"
+		"	head: *Node\n"
+		"}\n",
+	};
+
+	for_range (i, LEN(sources)) {
+		LineTable lines = init_line_table(sources[i], strlen(sources[i]));
+		Lexer     lex   = init_lexer(sources[i], strlen(sources[i]), &lines);
+		TypeTree  tree  = init_TypeTree();
+		AstResult ast   = get_ast(&lex, &tree);
+
+		ASSERT(!ast.err, "type used before its declaration was taken as defined");
+		ASSERT(tree.aliases.len == 2, "types were not declared");
+
+		free_ast(&ast);
+		freetree(&tree);
+		free_line_table(&lines);
+	}
+
+	cstr twice =
+		"A :: struct {\n"
+		"	x: int\n"
+		"}\n"
+		"A :: struct {\n"
+		"	x: int\n"
+		"}\n"
+		"int :: struct {\n"
+		"	x: int\n"
+		"}\n";
+
+	LineTable lines = init_line_table(twice, strlen(twice));
+	Lexer     lex   = init_lexer(twice, strlen(twice), &lines);
+	TypeTree  tree  = init_TypeTree();
+
+	mute_errors(true);
+	AstResult ast = get_ast(&lex, &tree);
+	mute_errors(false);
+
+	ASSERT(ast.err && tree.aliases.len == 1, "a type was declared twice");
+
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// typeids are handed out in order and their leaves stay put as chunks are added
+static UnitTest_t type_handle_test(void) {
+	TypeTree tree  = init_TypeTree();
+	typeid   first = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_PTR });
+
+	ASSERT(type_leaf(&tree, VOID_ID) == NULL, "VOID_ID has a leaf");
+	ASSERT(first == tree.leaves, "handles are not dense");
+
+	TypeLeaf *leaf = type_leaf(&tree, first);
+	typeid    last = first;
+	for_range (i, TYPE_CHUNK * 3) {
+		last = get_leaf(&tree, last, &(TypeLeaf) { .tag = DBLTP_ARR, .size = i });
+	}
+
+	ASSERT(tree.leaves > TYPE_CHUNK * 3, "leaves did not span chunks");
+	ASSERT(type_leaf(&tree, first) == leaf, "leaf moved when the tree grew");
+	ASSERT(leaf->tag == DBLTP_PTR && leaf->next != NULL, "leaf was overwritten");
+	ASSERT(last == first + TYPE_CHUNK * 3, "handles are not dense");
+
+	// walking back up the parents ends at the root
+	u32 depth = 0;
+	for (typeid id = last; id != VOID_ID; id = type_leaf(&tree, id)->parent) depth++;
+	ASSERT(depth == TYPE_CHUNK * 3 + 1, "parents do not lead back to the root");
+
+	freetree(&tree);
+	END_UNIT_TEST();
+}
+
+#define SHARED_TYPES   64
+#define SHARED_THREADS 4
+
+typedef struct {
+	TypeTree *tree;
+	Symbol   *names;
+	u32       first; // where this thread starts in the list, so they collide
+	typeid    types[SHARED_TYPES];
+} TypeWorker;
+
+// ?[n]*Tn, and (Tn, ?[n]*Tn) -> Tn over the same leaves
+static int intern_worker(void *arg) {
+	TypeWorker *w = arg;
+
+	for_range (j, SHARED_TYPES) {
+		const u32 i = (w->first + j) % SHARED_TYPES;
+
+		typeid opt  = get_leaf(w->tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_OPT });
+		typeid arr  = get_leaf(w->tree, opt, &(TypeLeaf) { .tag = DBLTP_ARR, .size = i });
+		typeid ptr  = get_leaf(w->tree, arr, &(TypeLeaf) { .tag = DBLTP_PTR });
+		typeid name = get_leaf(w->tree, ptr, &(TypeLeaf) { .tag = DBLTP_NAME, .name = w->names[i] });
+
+		typeid args[] = { get_leaf(w->tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = w->names[i] }), name };
+		get_leaf(w->tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_FN, .fn = { .ret = args[0], .arr = args, .len = 2 } });
+
+		w->types[i] = name;
+	}
+
+	return 0;
+}
+
+// parsers on several threads share a tree and still agree on every typeid
+static UnitTest_t type_shared_test(void) {
+	TypeTree   tree = init_TypeTree();
+	Symbol     names[SHARED_TYPES];
+	TypeWorker workers[SHARED_THREADS];
+	thrd_t     threads[SHARED_THREADS];
+
+	// the interner is not thread safe, the names are made up front
+	for_range (i, SHARED_TYPES) {
+		char name[16];
+		snprintf(name, sizeof(name), "S%d", i);
+		names[i] = intern_cstr(name);
+	}
+
+	for_range (t, SHARED_THREADS) {
+		workers[t] = (TypeWorker) { .tree = &tree, .names = names, .first = t * SHARED_TYPES / SHARED_THREADS };
+		ASSERT(thrd_create(&threads[t], intern_worker, &workers[t]) == thrd_success, "could not start a thread");
+	}
+
+	for_range (t, SHARED_THREADS) thrd_join(threads[t], NULL);
+
+	for_range (i, SHARED_TYPES) {
+		for_range (t, SHARED_THREADS) {
+			ASSERT(workers[t].types[i] == workers[0].types[i], "threads got different typeids for a type");
+		}
+	}
+
+	// 7 builtins, ?, [n], * and Tn under each, Tn and a fn at the root
+	ASSERT(tree.leaves == 7 + 1 + SHARED_TYPES * 5, "a type was added more than once");
+
+	freetree(&tree);
+	END_UNIT_TEST();
+}
+
+// every name in an alias chain resolves to the type at its end
+static UnitTest_t type_alias_test(void) {
+#define ALIAS_CHAIN 64
+	cstr buffer =
+		"Meters :: alias int\n"
+		"Length :: alias Meters\n"
+		"Pair :: struct {\n"
+		"	a: Length\n"
+		"}\n"
+		"Couple :: alias Pair\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err, "parse failed");
+	ASSERT(tree.aliases.len == 4, "aliases were not added");
+
+	typeid ints   = basic_type(&tree, INT_INDEX);
+	typeid length = tree.aliases.arr[1].from;
+	typeid pair   = tree.aliases.arr[2].to;
+
+	ASSERT(canonical_type(&tree, tree.aliases.arr[0].from) == ints, "alias does not resolve");
+	ASSERT(canonical_type(&tree, length) == ints, "alias of an alias does not resolve");
+	ASSERT(canonical_type(&tree, tree.aliases.arr[3].from) == pair, "alias of a struct does not resolve");
+	ASSERT(canonical_type(&tree, ints) == ints, "a type that is no alias is not its own");
+	ASSERT(canonical_type(&tree, VOID_ID) == VOID_ID, "VOID_ID resolved to a type");
+	ASSERT(type_leaf(&tree, length)->canon == ints, "resolved alias does not link to its type");
+
+	// A0 -> A1 -> ... -> Length, each alias declared before what it stands for
+	typeid names[ALIAS_CHAIN];
+	for_range (i, ALIAS_CHAIN) {
+		char name[16];
+		snprintf(name, sizeof(name), "A%d", i);
+		names[i] = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr(name) });
+		if (i > 0) add_typedef(&tree, names[i - 1], names[i]);
+	}
+
+	add_typedef(&tree, names[ALIAS_CHAIN - 1], length);
+	add_typedef(&tree, length, names[0]); // a cycle, left as it is
+
+	ASSERT(canonical_type(&tree, names[0]) == ints, "alias chain does not resolve");
+
+	u32 depth = 0;
+	for (typeid id = names[0]; id != ints; id = type_leaf(&tree, id)->canon) depth++;
+	ASSERT(depth <= ALIAS_CHAIN / 2 + 1, "resolving did not shorten the chain");
+
+	for_range (i, ALIAS_CHAIN) {
+		ASSERT(canonical_type(&tree, names[i]) == ints, "alias in a chain does not resolve");
+	}
+
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// offsets in declaration order, then reordered by alignment and with a hot member
+static UnitTest_t type_layout_test(void) {
+	cstr buffer =
+		"Rec :: struct {\n"
+		"	a: bool\n"
+		"	b: dooble\n"
+		"	c: char\n"
+		"	d: int\n"
+		"	e: *Rec\n"
+		"}\n"
+		"Parts :: struct {\n"
+		"	i: int\n"
+		"	d: dooble\n"
+		"	s: []u8\n"
+		"}\n"
+		"Wrap :: struct {\n"
+		"	r: [2]Rec\n"
+		"	o: ?int\n"
+		"	s: []u8\n"
+		"}\n"
+		"Self :: struct {\n"
+		"	s: Self\n"
+		"}\n"
+		"Held :: struct {\n"
+		"	p: *struct {\n"
+		"		a: bool\n"
+		"		b: dooble\n"
+		"	}\n"
+		"	q: [2]struct {\n"
+		"		a: bool\n"
+		"		b: dooble\n"
+		"	}\n"
+		"}\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err, "parse failed");
+	ASSERT(tree.aliases.len == 5, "types were not declared");
+
+	const typeid rec  = tree.aliases.arr[0].to;
+	const typeid wrap = tree.aliases.arr[2].to;
+	const typeid self = tree.aliases.arr[3].to;
+	const typeid ptr  = type_leaf(&tree, tree.aliases.arr[4].to)->members.arr[0].type;
+	const typeid arr  = type_leaf(&tree, tree.aliases.arr[4].to)->members.arr[1].type;
+
+	// the parser does not take sumtypes yet, so Parts is turned into one
+	TypeLeaf merged    = *type_leaf(&tree, tree.aliases.arr[1].to);
+	merged.tag         = DBLTP_UNION;
+	const typeid shape = get_leaf(&tree, VOID_ID, &merged);
+
+	Layouts layouts = init_layouts(&tree, false);
+
+	const u64 declared[] = { 0, 8, 16, 20, 24 };
+	ASSERT(type_layout(&layouts, rec)->size == 32, "struct has the wrong size");
+	ASSERT(type_layout(&layouts, rec)->align == 8, "struct has the wrong alignment");
+	for_range (i, LEN(declared)) {
+		ASSERT(member_offset(&layouts, rec, i) == declared[i], "member has the wrong offset");
+		ASSERT(member_at(&layouts, rec, i) == i, "members moved without reordering");
+	}
+
+	ASSERT(type_layout(&layouts, shape)->size == 16, "sumtype is not as big as its biggest member");
+	ASSERT(member_offset(&layouts, shape, 1) == 0, "sumtype member is not at 0");
+
+	ASSERT(type_layout(&layouts, wrap)->size == 96, "array, option or slice has the wrong size");
+	ASSERT(member_offset(&layouts, wrap, 1) == 64, "member after an array has the wrong offset");
+	ASSERT(member_offset(&layouts, wrap, 2) == 80, "member after an option has the wrong offset");
+
+	ASSERT(type_layout(&layouts, self)->align == 0, "struct that holds itself has a layout");
+	ASSERT(member_at(&layouts, self, 0) == 0, "struct without a layout is not in declaration order");
+	free_layouts(&layouts);
+
+	// b e d a c
+	layouts = init_layouts(&tree, true);
+
+	const u64 reordered[] = { 20, 0, 21, 16, 8 };
+	ASSERT(type_layout(&layouts, rec)->size == 24, "reordering did not remove padding");
+	ASSERT(member_at(&layouts, rec, 1) == 4, "members are not by descending alignment");
+	for_range (i, LEN(reordered)) {
+		ASSERT(member_offset(&layouts, rec, i) == reordered[i], "reordered member has the wrong offset");
+	}
+
+	ASSERT(member_offset(&layouts, shape, 2) == 0, "sumtype members were reordered");
+
+	// the struct under a modifier is laid out on its own, b a
+	ASSERT(type_layout(&layouts, ptr)->size == 8, "pointer to a struct has the wrong size");
+	ASSERT(type_layout(&layouts, arr)->size == 32, "array of structs has the wrong size");
+	ASSERT(member_at(&layouts, ptr, 0) == 1 && member_offset(&layouts, ptr, 0) == 8, "struct under a pointer was not reordered");
+	ASSERT(member_at(&layouts, arr, 0) == 1 && member_offset(&layouts, arr, 0) == 8, "struct under an array was not reordered");
+	free_layouts(&layouts);
+
+	// c b e d a
+	layouts = init_layouts(&tree, true);
+	mark_hot(&layouts, rec, 2);
+
+	const u64 hot[] = { 28, 8, 0, 24, 16 };
+	ASSERT(member_at(&layouts, rec, 0) == 2, "hot member is not first");
+	ASSERT(type_layout(&layouts, rec)->size == 32, "struct with a hot member has the wrong size");
+	for_range (i, LEN(hot)) {
+		ASSERT(member_offset(&layouts, rec, i) == hot[i], "member after a hot one has the wrong offset");
+	}
+
+	free_layouts(&layouts);
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// repeated types come back from the memo as the leaf a fresh walk would build
+static UnitTest_t parse_type_memo_test(void) {
+	cstr buffer =
+		"Pair :: struct {\n"
+		"	a: *[]int\n"
+		"	b: ?int\n"
+		"	c: *[]int\n"
+		"}\n"
+		"x: *[]int = nil\n"
+		"f: (int, *[]int) -> ?int = nil\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err, "parse failed");
+	ASSERT(ast.pool->block.len == 2, "expected 2 declarations after the struct");
+	ASSERT(tree.aliases.len == 1, "struct was not added as a type");
+
+	typeid ptr   = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_PTR });
+	typeid slice = get_leaf(&tree, ptr, &(TypeLeaf) { .tag = DBLTP_SLICE });
+	typeid ints  = get_leaf(&tree, slice, &(TypeLeaf) { .tag = DBLTP_NAME, .name = intern_cstr("int") });
+
+	const TypeLeaf *pair = type_leaf(&tree, tree.aliases.arr[0].to);
+	const TypeLeaf *fn   = type_leaf(&tree, ast.pool->block.arr[1]->declare.type);
+
+	ASSERT(pair->tag == DBLTP_STRUCT && pair->members.len == 3, "struct members were not parsed");
+	ASSERT(pair->members.arr[0].type == ints, "member type is not the walked leaf");
+	ASSERT(pair->members.arr[2].type == ints, "repeated member type is not the same leaf");
+	ASSERT(pair->members.arr[1].type != ints, "different types share a leaf");
+	ASSERT(ast.pool->block.arr[0]->declare.type == ints, "declaration type is not the same leaf");
+
+	ASSERT(fn->tag == DBLTP_FN && fn->fn.len == 2, "function type was not parsed");
+	ASSERT(fn->fn.arr[1] == ints, "argument type is not the same leaf");
+	ASSERT(fn->fn.ret == pair->members.arr[1].type, "return type is not the same leaf");
+
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	// a remembered type followed by more of a type is still an error
+	const char *broken[] = {
+		"x: int = nil\ny: int( = nil\n",
+		"x: int = nil\ny: int* = nil\n",
+		"x: int = nil\ny: int[4] = nil\n",
+		"x: int = nil\ny: int? = nil\n",
+		"x: int = nil\ny: int struct = nil\n",
+		"x: () = nil\ny: ()* = nil\n",
+	};
+
+	for_range (i, LEN(broken)) {
+		lines = init_line_table(broken[i], strlen(broken[i]));
+		lex   = init_lexer(broken[i], strlen(broken[i]), &lines);
+		tree  = init_TypeTree();
+
+		mute_errors(true);
+		ast = get_ast(&lex, &tree);
+		mute_errors(false);
+
+		const Node *y = ast.pool->block.len > 1 ? ast.pool->block.arr[1] : NULL;
+		ASSERT(ast.err, "accepted a bad type after a good one");
+		ASSERT(y == NULL || y->tag != EX_DECL || y->declare.type == VOID_ID, "bad type came from the memo");
+
+		free_ast(&ast);
+		freetree(&tree);
+		free_line_table(&lines);
+	}
+
+	END_UNIT_TEST();
+}
+
+// walks both encodings side by side, children must come after their parent
+static bool same_tree(const Node *node, const CompactAst *ast, NodeIndex i, NodeIndex parent) {
+	if (node == NULL) return i == NO_NODE;
+	if (i <= parent && i != 0) return false;
+	if (ast->tags[i] != node->tag) return false;
+
+	const NodeData data  = ast->data[i];
+	const u32     *extra = ast->extra.arr;
+
+	switch (node->tag) {
+		case EX_IF:
+			return same_tree(node->ifstmt.condition, ast, data.lhs, i)
+				&& same_tree(node->ifstmt.stmt, ast, extra[data.rhs], i)
+				&& same_tree(node->ifstmt.else_case, ast, extra[data.rhs + 1], i);
+		case EX_FOREACH: case EX_DOEACH: case EX_DONTEACH:
+			return compact_symbol(ast, extra[data.lhs]) == node->foreach.ident
+				&& same_tree(node->foreach.range, ast, extra[data.lhs + 1], i)
+				&& same_tree(node->foreach.stmt, ast, data.rhs, i);
+		case EX_FORWHILE: case EX_DOWHILE: case EX_DONTWHILE:
+			return same_tree(node->forwhile.condition, ast, data.lhs, i)
+				&& same_tree(node->forwhile.stmt, ast, data.rhs, i);
+		case EX_BLOCK:
+			if (data.rhs != node->block.len) return false;
+			for_range (c, node->block.len) {
+				if (!same_tree(node->block.arr[c], ast, extra[data.lhs + c], i)) return false;
+			}
+			return true;
+		case EX_DECL:
+			return compact_symbol(ast, extra[data.lhs]) == node->declare.name
+				&& ast->types.arr[extra[data.lhs + 1]] == node->declare.type
+				&& (bool) (ast->flags[i] & DECL_CONST) == node->declare.is_const
+				&& same_tree(node->declare.assign, ast, data.rhs, i);
+		case EX_BINOP:
+			return ast->flags[i] == node->binop.operator
+				&& same_tree(node->binop.expra, ast, data.lhs, i)
+				&& same_tree(node->binop.exprb, ast, data.rhs, i);
+		case EX_UNARY:
+			return ast->flags[i] == node->unary.operator
+				&& same_tree(node->unary.expr, ast, data.lhs, i);
+		case EX_CALL:
+			if (!same_tree(node->call.caller, ast, data.lhs, i)) return false;
+			if (extra[data.rhs] != node->call.len) return false;
+			for_range (c, node->call.len) {
+				if (!same_tree(node->call.params[c], ast, extra[data.rhs + 1 + c], i)) return false;
+			}
+			return true;
+		case EX_SUBMEMBER:
+			return compact_symbol(ast, data.rhs) == node->member.name
+				&& same_tree(node->member.expr, ast, data.lhs, i);
+		case EX_FUNCTION:
+			if (extra[data.rhs + 1] != node->function.args.len) return false;
+			for_range (c, node->function.args.len) {
+				if (!same_tree(node->function.args.arr[c], ast, extra[data.rhs + 2 + c], i)) return false;
+			}
+			return same_tree(node->function.block, ast, data.lhs, i);
+		case EX_LITERAL:
+			if (ast->flags[i] != node->literal.tag) return false;
+			switch (node->literal.tag) {
+				case LIT_STR:
+					return data.rhs == node->literal.str.size
+						&& memcmp(&ast->text.arr[data.lhs], node->literal.str.str, data.rhs) == 0;
+				case LIT_IDENT: return compact_symbol(ast, data.lhs) == node->literal.ident;
+				case LIT_NUM:   return ((u64) data.rhs << 32 | data.lhs) == (u64) node->literal.numi;
+				default:        return true;
+			}
+		default:
+			return true;
+	}
+}
+
+static UnitTest_t compact_ast_test(void) {
+	cstr buffer =
+		"add :: () {\n"
+		"	if a < b {\n"
+		"		a\n"
+		"	} else {\n"
+		"		-b\n"
+		"	}\n"
+		"	for a < 10 {\n"
+		"		print('hi', a * 1.5, 0..10)\n"
+		"	}\n"
+		"}\n"
+		"x := add(1, 2).result + 4294967297\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	CompactAst compact = compact_ast(&ast);
+
+	ASSERT(compact.len > 1 && compact.len <= ast.pool_size, "nodes were not all lowered");
+	ASSERT(compact.tags[0] == EX_BLOCK, "root is not the global scope");
+	ASSERT(same_tree(ast.pool, &compact, 0, 0), "compact ast differs from the tree");
+	ASSERT(compact_ast_size(&compact) * 2 <= sizeof(Node) * compact.len, "compact ast is not smaller");
+
+	print_compact_ast(&compact, 0);
+
+	free_compact_ast(&compact);
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+static UnitTest_t ast_cache_test(void) {
+	cstr buffer =
+		"add :: () {\n"
+		"	print('sum', a + b, 2.5)\n"
+		"}\n"
+		"x := add(1, 2).result + 4294967297\n";
+
+	LineTable lines = init_line_table(buffer, strlen(buffer));
+	Lexer     lex   = init_lexer(buffer, strlen(buffer), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult ast   = get_ast(&lex, &tree);
+
+	ASSERT(!ast.err && ast.pool->block.len == 2, "could not parse the source");
+
+	// types as parse_type would build them: (int) -> bool and *int
+	typeid    args[] = { basic_type(&tree, INT_INDEX) };
+	Function *add    = &ast.pool->block.arr[0]->declare.assign->function;
+	Node     *x      = ast.pool->block.arr[1];
+
+	add->ret_type = get_leaf(&tree, VOID_ID, &(TypeLeaf) {
+		.tag = DBLTP_FN,
+		.fn  = { .ret = basic_type(&tree, BOOL_INDEX), .arr = args, .len = 1 },
+	});
+
+	typeid ptr = get_leaf(&tree, VOID_ID, &(TypeLeaf) { .tag = DBLTP_PTR });
+	x->declare.type = get_leaf(&tree, ptr, &(TypeLeaf) {
+		.tag  = DBLTP_NAME,
+		.name = intern_cstr("int"),
+	});
+
+	CompactAst compact = compact_ast(&ast);
+
+	const u32 len  = strlen(buffer);
+	const u64 hash = source_hash(buffer, len);
+	ASSERT(save_ast_cache(".", buffer, len, &tree, &compact), "could not save the cache");
+
+	CompactAst loaded;
+	ASSERT(!load_ast_cache(".", buffer, len - 1, &tree, &loaded), "loaded a cache for other source");
+	ASSERT(load_ast_cache(".", buffer, len, &tree, &loaded), "could not load the cache");
+
+	ASSERT(loaded.view.data != NULL && (const char *) loaded.tags > loaded.view.data, "nodes are not read in place");
+	ASSERT(loaded.len == compact.len && loaded.extra.len == compact.extra.len, "wrong sizes");
+	ASSERT(same_tree(ast.pool, &loaded, 0, 0), "loaded ast differs from the tree");
+
+	for_range (i, compact.types.len) {
+		ASSERT(loaded.types.arr[i] == compact.types.arr[i], "type did not come back as the same leaf");
+	}
+
+	char path[FILENAME_MAX];
+	ast_cache_path(path, sizeof(path), ".", hash);
+
+	// a corrupt file is a miss, not a crash later on
+	string_t  file   = read_file(path);
+	const u32 size   = file.size;
+	NodeData *root   = (NodeData *) &file.str[(const char *) loaded.data - loaded.view.data];
+	u32      *stmts  = (u32 *) &file.str[(const char *) loaded.extra.arr - loaded.view.data];
+	CompactAst corrupt;
+
+	// other source of the same length whose hash collides, forged by renaming
+	char      other[]    = "add :: () {\n	print('SUM', a + b, 2.5)\n}\nx := add(1, 2).result + 4294967297\n";
+	const u64 other_hash = source_hash(other, len);
+	char      other_path[FILENAME_MAX];
+	ast_cache_path(other_path, sizeof(other_path), ".", other_hash);
+
+	// the hash comes right after magic and version
+	memcpy(&file.str[sizeof(u64)], &other_hash, sizeof(u64));
+	write_file(&file, other_path);
+	ASSERT(!load_ast_cache(".", other, len, &tree, &corrupt), "loaded a cache for a hash collision");
+	memcpy(&file.str[sizeof(u64)], &hash, sizeof(u64));
+	remove(other_path);
+
+	file.size = size / 2;
+	write_file(&file, path);
+	ASSERT(!load_ast_cache(".", buffer, len, &tree, &corrupt), "loaded a truncated cache");
+	file.size = size;
+
+	root->rhs = UINT32_MAX;
+	write_file(&file, path);
+	ASSERT(!load_ast_cache(".", buffer, len, &tree, &corrupt), "loaded a block longer than extra");
+	root->rhs = 2;
+
+	stmts[0] = loaded.len;
+	write_file(&file, path);
+	ASSERT(!load_ast_cache(".", buffer, len, &tree, &corrupt), "loaded a child past the nodes");
+
+	stmts[0] = 1;
+
+	// the first statement's value is itself
+	const u32 value = root[1].rhs;
+	root[1].rhs = 1;
+	write_file(&file, path);
+	ASSERT(!load_ast_cache(".", buffer, len, &tree, &corrupt), "loaded a node that holds itself");
+	root[1].rhs = value;
+	write_file(&file, path);
+	ASSERT(load_ast_cache(".", buffer, len, &tree, &corrupt), "could not load the restored cache");
+	free_compact_ast(&corrupt);
+
+	/* the return type of add gets a new name and the length of the name in *int,
+	 * the last type, runs past the file. Nothing of it may reach the tree */
+	u32 *word = (u32 *) &file.str[size - sizeof(u32)];
+	while (memcmp(word, "int", 4) != 0) word--;
+	word[-1] = UINT32_MAX;
+
+	while (memcmp(word, "bool", 4) != 0) word--;
+	memcpy(word, "boox", 4);
+
+	const u32 leaves = tree.leaves;
+	write_file(&file, path);
+	ASSERT(!load_ast_cache(".", buffer, len, &tree, &corrupt), "loaded a name past the type words");
+	ASSERT(tree.leaves == leaves, "a broken cache added types");
+
+	freestr(&file);
+	free_compact_ast(&loaded);
+	free_compact_ast(&compact);
+	remove(path);
+
+	free_ast(&ast);
+	freetree(&tree);
+	free_line_table(&lines);
+
+	END_UNIT_TEST();
+}
+
+// parses `after` in full and checks that `ast` came out the same
+static bool same_as_full_parse(const AstResult *ast, cstr after) {
+	LineTable lines = init_line_table(after, strlen(after));
+	Lexer     lex   = init_lexer(after, strlen(after), &lines);
+	TypeTree  tree  = init_TypeTree();
+	AstResult full  = get_ast(&lex, &tree);
+
+	CompactAst compact = compact_ast(&full);
+	const bool same    = !full.err && same_tree(ast->pool, &compact, 0, 0);
+
+	free_compact_ast(&compact);
+	free_ast(&full);
+	freetree(&tree);
+	free_line_table(&lines);
+	return same;
+}
+
+static UnitTest_t reparse_test(void) {
+	cstr before = "a := 1\nb := f(2, 3)\n\nc := 'hi'\nd := 4\n";
+	cstr after  = "a := 1\nb := g(2)\n\nc := 'hi'\nd := 4\ne := 5\n";
+	const Edit edits[] = {
+		{ .start = 12, .end = 19, .len = 4 }, // f(2, 3) -> g(2)
+		{ .start = 38, .end = 38, .len = 7 }, // e := 5 at the end
+	};
+
+	TypeTree  tree = init_TypeTree();
+	LineTable old_lines = init_line_table(before, strlen(before));
+	Lexer     old_lex   = init_lexer(before, strlen(before), &old_lines);
+	AstResult ast       = get_ast(&old_lex, &tree);
+
+	ASSERT(!ast.err && ast.pool->block.len == 4, "could not parse the original");
+	ASSERT(ast.bounds[0] == 7 && ast.bounds[1] == 21 && ast.bounds[3] == 38, "wrong statement bounds");
+
+	const Node *a = ast.pool->block.arr[0];
+	const Node *c = ast.pool->block.arr[2];
+
+	LineTable lines  = init_line_table(after, strlen(after));
+	Lexer     lex    = init_lexer(after, strlen(after), &lines);
+	AstResult edited = reparse_ast(&ast, &lex, &tree, edits, 2);
+
+	ASSERT(!edited.err && edited.pool->block.len == 5, "wrong number of statements");
+	ASSERT(edited.pool->block.arr[0] == a && edited.pool->block.arr[2] == c, "untouched statements were parsed again");
+	ASSERT(edited.bounds[2] == 28 && edited.bounds[4] == strlen(after), "bounds were not moved");
+	ASSERT(same_as_full_parse(&edited, after), "reparse differs from a full parse");
+
+	// opens a function in the first statement and closes it in the last, the
+	// run can't be parsed on its own
+	cstr wrapped = "f :: () {\nb := g(2)\n\nc := 'hi'\nd := 4\n}\n";
+	const Edit wrap[] = {
+		{ .start = 0,  .end = 6,  .len = 9 },
+		{ .start = 35, .end = 41, .len = 1 },
+	};
+
+	LineTable wrap_lines = init_line_table(wrapped, strlen(wrapped));
+	Lexer     wrap_lex   = init_lexer(wrapped, strlen(wrapped), &wrap_lines);
+	AstResult full       = reparse_ast(&edited, &wrap_lex, &tree, wrap, 2);
+
+	ASSERT(!full.err && full.pool->block.len == 1, "did not fall back to a full parse");
+	ASSERT(same_as_full_parse(&full, wrapped), "fallback differs from a full parse");
+
+	free_ast(&full);
+	freetree(&tree);
+	free_line_table(&old_lines);
+	free_line_table(&lines);
+	free_line_table(&wrap_lines);
+
+	END_UNIT_TEST();
+}
+
+// declarations put their types in the tree, a reparse may only declare them again
+static UnitTest_t reparse_types_test(void) {
+	cstr before = "T :: struct {\n\tx: int\n}\na := 1\nU :: alias int\nb := 2\n";
+	cstr after  = "T :: struct {\n\tx: int\n}\na := 10\nU :: alias int\nb := 2\n";
+	cstr moved  = "b := 2\nT :: struct {\n\tx: int\n}\na := 10\nU :: alias int\n";
+	cstr broken = "b := 2\nT :: struct {\n\tx: float\n}\na := 10\nU :: alias int\n";
+
+	TypeTree  tree       = init_TypeTree();
+	LineTable old_lines  = init_line_table(before, strlen(before));
+	Lexer     old_lex    = init_lexer(before, strlen(before), &old_lines);
+	AstResult ast        = get_ast(&old_lex, &tree);
+	const u32 leaves     = tree.leaves;
+	const u32 aliases    = tree.aliases.len;
+
+	ASSERT(!ast.err && ast.pool->block.len == 2 && ast.ndecls == 2, "could not parse the original");
+	ASSERT(ast.decls[0].offset == 0 && ast.decls[1].offset == 31, "declarations are in the wrong place");
+
+	// 1 -> 10 in the statement after T, which T's text belongs to
+	const Edit edits[] = { { .start = 29, .end = 30, .len = 2 } };
+
+	LineTable lines  = init_line_table(after, strlen(after));
+	Lexer     lex    = init_lexer(after, strlen(after), &lines);
+	AstResult edited = reparse_ast(&ast, &lex, &tree, edits, 1);
+
+	ASSERT(!edited.err && edited.pool->block.len == 2, "declaration was taken for a redefinition");
+	ASSERT(edited.ndecls == 2 && edited.decls[1].offset == 32, "declarations did not move");
+	ASSERT(tree.aliases.len == aliases, "types were declared twice");
+	ASSERT(same_as_full_parse(&edited, after), "reparse differs from a full parse");
+
+	// b moves to the front, everything is parsed again
+	const Edit move[] = { { .start = 0, .end = strlen(after), .len = strlen(moved) } };
+
+	LineTable moved_lines = init_line_table(moved, strlen(moved));
+	Lexer     moved_lex   = init_lexer(moved, strlen(moved), &moved_lines);
+	AstResult reordered   = reparse_ast(&edited, &moved_lex, &tree, move, 1);
+
+	ASSERT(!reordered.err && reordered.pool->block.len == 2, "moved declarations were taken for redefinitions");
+	ASSERT(tree.leaves == leaves, "types were added again");
+
+	// a declared type can't change in the same tree
+	const Edit change[] = { { .start = 25, .end = 28, .len = 5 } };
+
+	LineTable broken_lines = init_line_table(broken, strlen(broken));
+	Lexer     broken_lex   = init_lexer(broken, strlen(broken), &broken_lines);
+	AstResult changed      = reparse_ast(&reordered, &broken_lex, &tree, change, 1);
+
+	ASSERT(changed.err, "changed type was accepted");
+
+	free_ast(&changed);
 	freetree(&tree);
+	free_line_table(&old_lines);
+	free_line_table(&lines);
+	free_line_table(&moved_lines);
+	free_line_table(&broken_lines);
 
 	END_UNIT_TEST();
 }
@@ -104,9 +1244,30 @@ MAKE_TEST dooble_tests(void) {
 	setupUnitTests();
 	ADD_TEST(lexer_test);
 	ADD_TEST(lexer_num_test);
+	ADD_TEST(lexer_num_edge_test);
 	ADD_TEST(num_greedy_test);
+	ADD_TEST(lexer_span_test);
+	ADD_TEST(keyword_test);
+	ADD_TEST(scan_test);
+	ADD_TEST(lexer_stream_test);
+	ADD_TEST(token_ring_test);
+	ADD_TEST(bracket_match_test);
+	ADD_TEST(lexer_parallel_test);
 	ADD_TEST(parse_call_test);
 	ADD_TEST(parse_test);
+	ADD_TEST(parse_lookahead_test);
 	ADD_TEST(parse_fn);
+	ADD_TEST(type_intern_test);
+	ADD_TEST(type_handle_test);
+	ADD_TEST(type_fingerprint_test);
+	ADD_TEST(type_declare_order_test);
+	ADD_TEST(type_shared_test);
+	ADD_TEST(type_alias_test);
+	ADD_TEST(type_layout_test);
+	ADD_TEST(parse_type_memo_test);
+	ADD_TEST(compact_ast_test);
+	ADD_TEST(ast_cache_test);
+	ADD_TEST(reparse_test);
+	ADD_TEST(reparse_types_test);
 }
 #endif
@@ -3,17 +3,70 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 typedef size_t TypePath[10]; // With 10 it takes 80 bytes. Should this be a vector?
 
-static bool leaf_eq(TypeLeaf *leafa, TypeLeaf *leafb) {
-	if (leafa->tag != leafb->tag) return false;
+#define TYPE_ARENA_INIT 4096 // bytes, a hundred branches
+#define BRANCH_SCAN_MAX 8    // leaves, a longer branch is looked up by hash
+
+static u64 mix(u64 hash, u64 value) {
+	return (hash ^ value) * 0x9E3779B97F4A7C15;
+}
+
+// 0 for VOID_ID, a leaf in the root has no parent to mix in
+static u64 fingerprint_of(const TypeTree *tree, typeid id) {
+	const TypeLeaf *leaf = type_leaf(tree, id);
+	return leaf == NULL ? 0 : leaf->fingerprint;
+}
+
+/* A fingerprint is a hash of the tag, the payload and the fingerprint of the
+ * parent, so it covers the whole type and not only its last leaf. Types in a
+ * payload go in by their fingerprint as well: two struct literals with the
+ * same members get the same one wherever the member types were added. A
+ * declared struct has its name mixed in, Vec2 and Point stay two types. */
+static u64 fingerprint(const TypeTree *tree, typeid base, const TypeLeaf *leaf) {
+	u64 hash = mix(fingerprint_of(tree, base), leaf->tag + 1);
+
+	switch (leaf->tag) {
+		case DBLTP_ARR:
+			return mix(hash, leaf->size);
+		case DBLTP_NAME:
+			return mix(hash, leaf->name);
+		case DBLTP_MAP:
+			hash = mix(hash, fingerprint_of(tree, leaf->map.key));
+			return mix(hash, fingerprint_of(tree, leaf->map.val));
+		case DBLTP_FN:
+			hash = mix(hash, fingerprint_of(tree, leaf->fn.ret));
+			hash = mix(hash, leaf->fn.len);
+			for_range (i, leaf->fn.len) hash = mix(hash, fingerprint_of(tree, leaf->fn.arr[i]));
+			return hash;
+
+		case DBLTP_STRUCT:
+		case DBLTP_UNION:
+			hash = mix(hash, leaf->members.named);
+			hash = mix(hash, leaf->members.len);
+			for_range (i, leaf->members.len) {
+				hash = mix(hash, leaf->members.arr[i].name);
+				hash = mix(hash, fingerprint_of(tree, leaf->members.arr[i].type));
+			}
+			return hash;
+
+		default:
+			return hash;
+	}
+}
+
+// print is the fingerprint of leafb. Only leaves that share it are compared
+// field by field, which is all a miss in a long branch costs
+static bool leaf_eq(const TypeLeaf *leafa, const TypeLeaf *leafb, u64 print) {
+	if (leafa->fingerprint != print || leafa->tag != leafb->tag) return false;
 
 	switch (leafa->tag) {
 		case DBLTP_ARR:
 			return leafa->size == leafb->size;
 		case DBLTP_NAME:
-			return strcmp(leafa->name.str, leafb->name.str) == 0;
+			return leafa->name == leafb->name;
 		case DBLTP_MAP:
 			return
 				leafa->map.key == leafb->map.key &&
@@ -32,104 +85,272 @@ static bool leaf_eq(TypeLeaf *leafa, TypeLeaf *leafb) {
 			}
 			return true;
 
+		// equal member types are already the same typeid
 		case DBLTP_STRUCT:
 			fallthrough;
 		case DBLTP_UNION:
-			return false;
-
-		default:
-			if (leafa->parent == NULL && leafb->parent == NULL) {
-				return true;
-			}
-			else if (leafa->parent == NULL || leafb->parent == NULL) {
+			if (leafa->members.len != leafb->members.len || leafa->members.named != leafb->members.named) {
 				return false;
 			}
 
-			return leaf_eq(leafa->parent, leafb->parent);
+			for_range (i, leafa->members.len) {
+				if (leafa->members.arr[i].name != leafb->members.arr[i].name
+						|| leafa->members.arr[i].type != leafb->members.arr[i].type)
+					return false;
+			}
+			return true;
+
+		// leaves are only compared within a branch, they share a parent
+		default:
+			return true;
 	}
 }
 
-bool leaf_exists(TypeTree *tree, TypeLeaf *base, TypeLeaf *leaf) {
-	TypeBranch *branch = NULL;
+/* Leaves are hash consed: a branch holds every leaf once, so two equal types
+ * are always the same typeid. A long branch (the root holds every named type)
+ * is indexed by the fingerprints of its leaves.
+ *
+ * Several parsers can share a tree. Looking a leaf up takes no lock: a reader
+ * loads len before arr and a slot before arr, and both are only stored once
+ * the leaf behind them is written, so it never sees a half made leaf. Only a
+ * miss takes the lock, looks again, and adds the leaf. Types are added once
+ * and looked up over and over, so one lock for the tree is rarely contended. */
+static u32 leaf_slot(const BranchIndex *index, u64 print) {
+	return (u32) (print >> 32) & index->mask;
+}
 
-	if (base == NULL) branch = &tree->branches[0];
-	else              return false;
+static void lock_tree(TypeTree *tree) {
+	while (atomic_flag_test_and_set_explicit(&tree->lock, memory_order_acquire)) thrd_yield();
+}
 
-	for_range (i, branch->len) {
-		if (leaf_eq(&branch->arr[i], leaf)) {
-			return true;
+static void unlock_tree(TypeTree *tree) {
+	atomic_flag_clear_explicit(&tree->lock, memory_order_release);
+}
+
+static void *keep_arr(TypeTree *tree, size_t size) {
+	void *arr = make(char, size);
+	if (arr == NULL) PANIC("could not allocate types");
+
+	EXTEND_ARR(void *, tree->arrays.arr, tree->arrays.len, tree->arrays.cap);
+	tree->arrays.arr[tree->arrays.len++] = arr;
+	return arr;
+}
+
+// like EXTEND_ARR, for the arrays lookups read. Stores the new one over arr
+// once it is a copy of the old
+#define REPLACE_ARR(tree, type, arr, len, cap)                                \
+	do {                                                                      \
+		if ((len) >= (cap)) {                                                 \
+			type *grown = keep_arr(tree, sizeof(type) * (cap) * 2);           \
+			memcpy(grown, arr, sizeof(type) * (cap));                         \
+			arr  = grown;                                                     \
+			cap *= 2;                                                         \
+		}                                                                     \
+	} while (0)
+
+static void index_leaf(const TypeTree *tree, BranchIndex *index, typeid id, size_t i) {
+	u32 slot = leaf_slot(index, type_leaf(tree, id)->fingerprint);
+	while (atomic_load_explicit(&index->slots[slot], memory_order_relaxed) != 0) {
+		slot = (slot + 1) & index->mask;
+	}
+
+	atomic_store_explicit(&index->slots[slot], i + 1, memory_order_release);
+}
+
+// sized so the branch is at most half full. The old index is left to readers
+// that still hold it, it only misses the newest leaves
+static void index_branch(TypeTree *tree, TypeBranch *branch) {
+	u32 cap = 2 * BRANCH_SCAN_MAX;
+	while (cap < branch->len * 2) cap *= 2;
+
+	BranchIndex *index = keep_arr(tree, sizeof(BranchIndex) + sizeof(atomic_uint) * cap);
+	index->mask = cap - 1;
+
+	for_range (i, branch->len) index_leaf(tree, index, branch->arr[i], i);
+	atomic_store_explicit(&branch->index, index, memory_order_release);
+}
+
+static typeid find_leaf(const TypeTree *tree, TypeBranch *branch, const TypeLeaf *leaf, u64 print) {
+	const BranchIndex *index = atomic_load_explicit(&branch->index, memory_order_acquire);
+
+	if (index == NULL) {
+		const size_t  len = atomic_load_explicit(&branch->len, memory_order_acquire);
+		const typeid *arr = atomic_load_explicit(&branch->arr, memory_order_acquire);
+
+		for_range (i, len) {
+			if (leaf_eq(type_leaf(tree, arr[i]), leaf, print)) return arr[i];
 		}
+
+		return VOID_ID;
 	}
 
-	return false;
+	u32 slot = leaf_slot(index, print);
+	for (u32 entry; (entry = atomic_load_explicit(&index->slots[slot], memory_order_acquire)) != 0;
+			slot = (slot + 1) & index->mask)
+	{
+		const typeid other = atomic_load_explicit(&branch->arr, memory_order_acquire)[entry - 1];
+		if (leaf_eq(type_leaf(tree, other), leaf, print)) return other;
+	}
+
+	return VOID_ID;
 }
 
-typeid get_leaf(TypeTree *tree, TypeLeaf *base, TypeLeaf *leaf) {
-	TypeBranch *branch = NULL;
+// the leaf at the end of arr was just added
+static void add_to_index(TypeTree *tree, TypeBranch *branch) {
+	BranchIndex *index = branch->index;
 
-	if (base == NULL) {
-		branch = &tree->branches[0];
+	if (index != NULL && branch->len * 2 <= index->mask + 1) {
+		index_leaf(tree, index, branch->arr[branch->len - 1], branch->len - 1);
 	}
-	else if (base->next == NULL) {
-		// creates a 'branch' and sets next to it.
-		EXTEND_ARR(TypeBranch, tree->branches, tree->len, tree->cap);
-		tree->branches[tree->len++] = (TypeBranch) {
-			.arr = make(TypeLeaf, 3),
-			.len = 0,
-			.cap = 3,
-		};
+	else if (branch->len > BRANCH_SCAN_MAX) {
+		index_branch(tree, branch);
+	}
+}
+
+static TypeBranch *new_branch(TypeTree *tree) {
+	TypeBranch *branch = arena_new(&tree->arena, TypeBranch);
+	*branch = (TypeBranch) {
+		.arr = keep_arr(tree, sizeof(typeid) * 4),
+		.len = 0,
+		.cap = 4,
+	};
+
+	return branch;
+}
+
+// the next free leaf, a chunk is only added when the last one is full
+static typeid new_leaf_id(TypeTree *tree) {
+	if (tree->leaves == UINT32_MAX - 1) PANIC("too many types");
+
+	if ((tree->leaves & (TYPE_CHUNK - 1)) == 0) {
+		const size_t chunk = tree->leaves >> TYPE_CHUNK_BITS;
 
-		base->next = &tree->branches[tree->len - 1];
-		branch     = base->next;
+		REPLACE_ARR(tree, TypeLeaf *, tree->chunks, chunk, tree->chunks_cap);
+		tree->chunks[chunk] = keep_arr(tree, sizeof(TypeLeaf) * TYPE_CHUNK);
 	}
 
-	for_range (i, branch->len) {
-		if (leaf_eq(&branch->arr[i], leaf)) {
-			return &branch->arr[i];
-		}
+	return ++tree->leaves;
+}
+
+// with the tree locked, after a lookup without it missed
+static typeid add_leaf(TypeTree *tree, typeid base, TypeLeaf *leaf, u64 print) {
+	TypeLeaf   *base_leaf = type_leaf(tree, base);
+	TypeBranch *branch    = base_leaf == NULL ? tree->root : base_leaf->next;
+
+	if (branch == NULL) {
+		// creates a 'branch' and sets next to it.
+		branch          = new_branch(tree);
+		base_leaf->next = branch;
+	}
+	else {
+		// another thread may have added it in the meantime
+		const typeid found = find_leaf(tree, branch, leaf, print);
+		if (found != VOID_ID) return found;
 	}
 
-	EXTEND_ARR(TypeLeaf, branch->arr, branch->len, branch->cap);
-	TypeLeaf *const new_leaf = &branch->arr[branch->len++];
+	const typeid    id       = new_leaf_id(tree);
+	TypeLeaf *const new_leaf = type_leaf(tree, id);
+	*new_leaf = *leaf;
 
+	// arrays are copied, the caller keeps its own
 	switch (leaf->tag) {
 		case DBLTP_FN:
-			new_leaf->fn.ret = leaf->fn.ret;
-			new_leaf->fn.len = leaf->fn.len;
 			new_leaf->fn.cap = leaf->fn.len;
 			new_leaf->fn.arr = make(typeid, leaf->fn.len);
-			memcpy(new_leaf->fn.arr, leaf->fn.arr, new_leaf->fn.len);
+			if (leaf->fn.len > 0) memcpy(new_leaf->fn.arr, leaf->fn.arr, sizeof(typeid) * leaf->fn.len);
 			break;
 
 		case DBLTP_STRUCT:
 		case DBLTP_UNION:
-			new_leaf->members.len = leaf->members.len;
 			new_leaf->members.cap = leaf->members.len;
 			new_leaf->members.arr = make(Member, leaf->members.len);
-			memcpy(new_leaf->members.arr, leaf->members.arr, new_leaf->members.len);
+			if (leaf->members.len > 0) {
+				memcpy(new_leaf->members.arr, leaf->members.arr, sizeof(Member) * leaf->members.len);
+			}
 			break;
 
-		case DBLTP_NAME:
-			new_leaf->name = copy_str(&leaf->name);
-			break;
+		default: break;
+	}
+	new_leaf->parent      = base;
+	new_leaf->canon       = VOID_ID;
+	new_leaf->declared    = false;
+	new_leaf->fingerprint = print;
+	new_leaf->next        = NULL;
+
+	// the leaf is written before it is published
+	REPLACE_ARR(tree, typeid, branch->arr, branch->len, branch->cap);
+	branch->arr[branch->len] = id;
+	atomic_store_explicit(&branch->len, branch->len + 1, memory_order_release);
+
+	add_to_index(tree, branch);
+	return id;
+}
+
+bool leaf_exists(TypeTree *tree, typeid base, TypeLeaf *leaf) {
+	if (base != VOID_ID) return false;
 
-		default: *new_leaf = *leaf;
+	return find_leaf(tree, tree->root, leaf, fingerprint(tree, VOID_ID, leaf)) != VOID_ID;
+}
+
+// every use of a name puts its leaf in the root, `A :: struct { b: B }` too.
+// Only a declaration marks it
+bool type_declared(TypeTree *tree, Symbol name) {
+	TypeLeaf     named = { .tag = DBLTP_NAME, .name = name };
+	const typeid found = find_leaf(tree, tree->root, &named, fingerprint(tree, VOID_ID, &named));
+
+	return found != VOID_ID && atomic_load_explicit(&type_leaf(tree, found)->declared, memory_order_acquire);
+}
+
+typeid get_leaf(TypeTree *tree, typeid base, TypeLeaf *leaf) {
+	TypeLeaf   *base_leaf = type_leaf(tree, base);
+	TypeBranch *branch    = base_leaf == NULL ? tree->root : base_leaf->next;
+	const u64   print     = fingerprint(tree, base, leaf);
+
+	if (branch != NULL) {
+		const typeid found = find_leaf(tree, branch, leaf, print);
+		if (found != VOID_ID) return found;
 	}
-	new_leaf->parent = base;
-	new_leaf->next   = NULL;
 
-	return new_leaf;
+	lock_tree(tree);
+	const typeid id = add_leaf(tree, base, leaf, print);
+	unlock_tree(tree);
+
+	return id;
 }
 
 typeid basic_type(TypeTree *tree, PrimativeIndex index) {
-	if (index < tree->branches->len) {
-		return &tree->branches[0].arr[index];
+	if (index < tree->root->len) {
+		return tree->root->arr[index];
 	}
 
 	return VOID_ID;
 }
 
+/* Aliases are a union find over the leaves. A leaf's canon links it to the
+ * type it stands for, and a leaf without one is canonical. Links are only
+ * ever added to a canonical leaf, so whatever a leaf links to leads to the
+ * same place later on. That lets canonical_type shorten paths as it walks
+ * them, without the lock: every leaf it passes is linked past its parent. */
+typeid canonical_type(TypeTree *tree, typeid type) {
+	if (type == VOID_ID) return VOID_ID;
+
+	loop {
+		TypeLeaf *const leaf   = type_leaf(tree, type);
+		typeid          parent = atomic_load_explicit(&leaf->canon, memory_order_acquire);
+		if (parent == VOID_ID) return type;
+
+		const typeid grand = atomic_load_explicit(&type_leaf(tree, parent)->canon, memory_order_acquire);
+		if (grand == VOID_ID) return parent;
+
+		// another thread may have moved it on already, that is just as good
+		atomic_compare_exchange_strong_explicit(&leaf->canon, &parent, grand,
+				memory_order_release, memory_order_relaxed);
+		type = grand;
+	}
+}
+
 void add_typedef(TypeTree *tree, typeid from, typeid to) {
+	lock_tree(tree);
 	EXTEND_ARR(TypeAlias,
 			tree->aliases.arr,
 			tree->aliases.len,
@@ -138,6 +359,16 @@ void add_typedef(TypeTree *tree, typeid from, typeid to) {
 	tree->aliases.arr[tree->aliases.len++] = (TypeAlias) {
 		.from = from, .to = to,
 	};
+	atomic_store_explicit(&type_leaf(tree, from)->declared, true, memory_order_release);
+
+	// an alias of itself, directly or through others, is left canonical
+	const typeid root   = canonical_type(tree, from);
+	const typeid target = canonical_type(tree, to);
+	if (root != VOID_ID && target != VOID_ID && root != target) {
+		atomic_store_explicit(&type_leaf(tree, root)->canon, target, memory_order_release);
+	}
+
+	unlock_tree(tree);
 }
 
 typeid as_pointer(TypeTree *tree, typeid type) {
@@ -149,17 +380,23 @@ typeid as_address(TypeTree *tree, typeid type) {
 }
 
 inline void add_type(TypeTree *tree, cstr typename) {
-	get_leaf(tree, NULL, &(TypeLeaf) {
+	const typeid type = get_leaf(tree, VOID_ID, &(TypeLeaf) {
 		.tag  = DBLTP_NAME,
-		.name = init_str(typename),
+		.name = intern_cstr(typename),
 	});
+
+	atomic_store_explicit(&type_leaf(tree, type)->declared, true, memory_order_release);
 }
 
 TypeTree init_TypeTree(void) {
 	TypeTree tree = {
-		.branches = make(TypeBranch, 5),
-		.len = 0,
-		.cap = 5,
+		.arena  = init_arena(TYPE_ARENA_INIT),
+		.lock   = ATOMIC_FLAG_INIT,
+		.arrays = {
+			.arr = make(void *, 16),
+			.len = 0,
+			.cap = 16,
+		},
 
 		.aliases = {
 			.arr = make(TypeAlias, 5),
@@ -180,12 +417,9 @@ TypeTree init_TypeTree(void) {
 		// NOTE: I may have fixed this already
 	};
 
-	EXTEND_ARR(TypeBranch, tree.branches, tree.len, tree.cap);
-	tree.branches[tree.len++] = (TypeBranch) {
-		.arr = make(TypeLeaf, 5),
-		.len = 0,
-		.cap = 5,
-	};
+	tree.root       = new_branch(&tree);
+	tree.chunks     = keep_arr(&tree, sizeof(TypeLeaf *) * 4);
+	tree.chunks_cap = 4;
 
 	add_type(&tree, "int");
 	add_type(&tree, "float");
@@ -230,47 +464,39 @@ TypeTree init_TypeTree(void) {
  * */
 
 bool freetree(TypeTree *tree) {
-	for_range (i, tree->len) {
-		TypeBranch *const branch = &tree->branches[i];
-
-		for_range (j, branch->len) {
-			if (branch->arr[j].tag == DBLTP_FN) {
-				if (branch->arr[j].fn.arr != NULL) {
-					free(branch->arr[j].fn.arr);
-				}
+	for (typeid id = 1; id <= tree->leaves; id++) {
+		TypeLeaf *const leaf = type_leaf(tree, id);
 
-				branch->arr[j].fn.len = 0;
-				branch->arr[j].fn.cap = 0;
+		if (leaf->tag == DBLTP_FN) {
+			if (leaf->fn.arr != NULL) {
+				free(leaf->fn.arr);
 			}
 
-			else if (branch->arr[j].tag == DBLTP_STRUCT
-					|| branch->arr[j].tag == DBLTP_UNION)
-			{
-				for_range (k, branch->arr[j].members.len) {
-					freestr(&branch->arr[j].members.arr[k].name);
-				}
-
-				free(branch->arr[j].members.arr);
-				branch->arr[j].members.len = 0;
-				branch->arr[j].members.cap = 0;
-				branch->arr[j].members.arr = NULL;
-			}
-
-			else if (branch->arr[j].tag == DBLTP_NAME) {
-				freestr(&branch->arr[j].name);
-			}
+			leaf->fn.len = 0;
+			leaf->fn.cap = 0;
 		}
 
-		free(branch->arr);
-		branch->len = 0;
-		branch->cap = 0;
-		branch->arr = NULL;
+		else if (leaf->tag == DBLTP_STRUCT || leaf->tag == DBLTP_UNION) {
+			free(leaf->members.arr);
+			leaf->members.len = 0;
+			leaf->members.cap = 0;
+			leaf->members.arr = NULL;
+		}
 	}
 
-	free(tree->branches);
-	tree->len      = 0;
-	tree->cap      = 0;
-	tree->branches = NULL;
+	for_range (i, tree->arrays.len) free(tree->arrays.arr[i]);
+	free(tree->arrays.arr);
+	tree->arrays.len = 0;
+	tree->arrays.cap = 0;
+	tree->arrays.arr = NULL;
+
+	tree->chunks     = NULL;
+	tree->chunks_cap = 0;
+	tree->leaves     = 0;
+	tree->root       = NULL;
+
+	// every branch
+	free_arena(&tree->arena);
 
 	// aliases
 	free(tree->aliases.arr);
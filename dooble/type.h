@@ -1,12 +1,18 @@
 #pragma once
 
 #include "../utils/utils.h"
+#include "../utils/arena.h"
 #include "../utils/hash.h"
+#include "../utils/intern.h"
 #include "../codegen/codegen.h"
+#include <stdatomic.h>
 
-// a very useful abstraction
-typedef void *typeid;
-#define VOID_ID nullptr
+// a very useful abstraction. index + 1 of a leaf in its TypeTree, 0 is no type
+typedef u32 typeid;
+#define VOID_ID 0
+
+#define TYPE_CHUNK_BITS 7
+#define TYPE_CHUNK      (1 << TYPE_CHUNK_BITS) // leaves
 
 typedef struct TypeBranch_t TypeBranch;
 
@@ -33,8 +39,8 @@ typedef struct { // NOTE: could use a hashmap
 
 // NOTE: could change to account for type evaluation & default values
 typedef struct {
-	string_t name;
-	typeid   type;
+	Symbol name;
+	typeid type;
 } Member;
 
 /* TypeLeaf should be a constant data type, so seperate heap allocations could be avoided
@@ -56,8 +62,8 @@ struct TypeLeaf_t {
 	} tag;
 
 	union {
-		size_t   size;
-		string_t name;
+		size_t size;
+		Symbol name;
 
 		struct {
 			typeid key;
@@ -75,27 +81,55 @@ struct TypeLeaf_t {
 			Member *arr; // arr
 			u16     cap;
 			u16     len;
+			Symbol  named; // the type `named :: struct` declares, NO_SYMBOL for a literal
 		} members;
 	};
 
-	TypeLeaf   *parent;
-	TypeBranch *next;
+	typeid              parent;
+	_Atomic typeid      canon;       // union find link of an alias, VOID_ID once canonical
+	atomic_bool         declared;    // a name add_type or add_typedef gave a type, not one only used
+	u64                 fingerprint; // of the whole type, equal types always share one
+	TypeBranch *_Atomic next;
 };
 
+typedef struct {
+	u32         mask;
+	atomic_uint slots[]; // index + 1 into arr, 0 is empty
+} BranchIndex;
+
+/* A branch is read without a lock while another thread may be adding to it.
+ * Its arrays are replaced rather than resized and the old ones are kept with
+ * the tree, and len and index are only published once what they point at is
+ * written. */
 struct TypeBranch_t {
-	TypeLeaf *arr; // arr
-	size_t    cap;
-	size_t    len;
+	typeid *_Atomic arr; // arr
+	size_t          cap;
+	atomic_size_t   len;
+
+	// by leaf hash. Only made once the branch is too long to scan, most
+	// branches hold a handful of leaves
+	BranchIndex *_Atomic index;
 };
 
 typedef struct {
-	struct {
-		TypeBranch *branches;
-		size_t      len;
-		size_t      cap;
-	};
-
-	// OPTIM: Should this be a hash map? it would make sense
+	// leaves are kept in chunks of TYPE_CHUNK and branches in the arena.
+	// Neither ever moves, so a typeid and the leaf it names stay valid for as
+	// long as the tree does. The list of chunks is replaced like a branch's arr
+	Arena              arena;
+	TypeLeaf **_Atomic chunks; // arr
+	size_t             chunks_cap;
+	u32                leaves;
+	TypeBranch        *root;
+
+	// every chunk and array a lookup reads, replaced ones too. They are only
+	// freed with the tree, another thread may still be reading an old one
+	VEC(void *) arrays;
+
+	// taken to add a leaf or an alias, looking a leaf up never waits on it
+	atomic_flag lock;
+
+	// in the order they were declared. Resolving one goes through canon on
+	// the leaf instead, see canonical_type
 	VEC(TypeAlias) aliases; // NOTE: distinct?
 } TypeTree;
 
@@ -109,11 +143,20 @@ typedef enum : u8 {
 	NULL_INDEX,
 } PrimativeIndex;
 
+// NULL for VOID_ID
+static inline TypeLeaf *type_leaf(const TypeTree *tree, typeid id) {
+	if (id == VOID_ID) return NULL;
+
+	return &tree->chunks[(id - 1) >> TYPE_CHUNK_BITS][(id - 1) & (TYPE_CHUNK - 1)];
+}
+
 TypeTree init_TypeTree(void);
-bool     leaf_exists(TypeTree *tree, TypeLeaf *base, TypeLeaf *leaf);
-typeid   get_leaf(TypeTree *tree, TypeLeaf *base, TypeLeaf *leaf);
+bool     leaf_exists(TypeTree *tree, typeid base, TypeLeaf *leaf);
+bool     type_declared(TypeTree *tree, Symbol name); // false for a name that was only used so far
+typeid   get_leaf(TypeTree *tree, typeid base, TypeLeaf *leaf);
 void     add_type(TypeTree *tree, cstr typename);
 void     add_typedef(TypeTree *tree, typeid from, typeid to);
+typeid   canonical_type(TypeTree *tree, typeid type); // what an alias stands for, other types are their own
 typeid   basic_type(TypeTree *tree, PrimativeIndex index);
 typeid   as_pointer(TypeTree *tree, typeid type); // TODO: implementation
 typeid   as_address(TypeTree *tree, typeid type); // TODO: implementation
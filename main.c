@@ -1,6 +1,7 @@
 #include "strutils/str.h"
 #include "testing/testing.h"
 #include "utils/err.h"
+#include "utils/intern.h"
 #include "testing/logging.h"
 #include "utils/utils.h"
 #include <stdio.h>
@@ -10,6 +11,10 @@
 #define DEPLICATE 0
 #endif
 
+#ifdef BENCH
+int dooble_bench(int argc, char **argv); // dooble/bench.c
+#endif
+
 // NOTE: for now I am working on the actual dooble language, not deplicate.
 // While working on deplicate would be a lot of fun, I don't want to spend
 // all of my time working on what was supposed to be a weeklong project.
@@ -52,7 +57,15 @@ int main(int argc, char **argv) {
 		unitTestEntry();
 	}
 
+	int regressions = 0;
+#	ifdef BENCH
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		regressions = dooble_bench(argc - 2, argv + 2);
+	}
+#	endif
+
+	free_symbols();
 	END_MEMORY_TESTS();
 	ENDLOG();
-	return 0;
+	return regressions > 0;
 }
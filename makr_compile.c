@@ -3,7 +3,9 @@
 
 #define TESTING   "testing/testing.c", "testing/logging.c"
 #define STR_UTILS "strutils/str.c", "strutils/template/template.c"
-#define UTILS     "utils/err.c", "utils/file.c", "utils/hash.c", "utils/input.c"
+#define UTILS     "utils/err.c", "utils/file.c", "utils/hash.c", "utils/input.c", \
+                  "utils/intern.c", "utils/lines.c", "utils/decimal.c", \
+                  "utils/arena.c"
 
 #define C_GEN "codegen/codegen.c"
 
@@ -17,11 +19,15 @@
 
 #define DOOBLE                       \
 	"dooble/lexer.c",                \
+	"dooble/scan.c",                 \
 	"dooble/parse.c",                \
+	"dooble/compact.c",              \
+	"dooble/cache.c",                \
 	"dooble/print_ast.c",            \
 	"dooble/tests.c",                \
 	"dooble/type.c",                 \
 	"dooble/backend/cgen/typegen.c", \
+	"dooble/backend/cgen/layout.c",  \
 	"dooble/pass/semantic.c"
 
 #define WARNINGS                   \
@@ -45,6 +51,7 @@ struct {
 	bool release:   1;
 	bool run:       1;
 	bool debug:     1;
+	bool bench:     1;
 } build_flags;
 
 void build(int argc, char *argv[]) {
@@ -54,6 +61,7 @@ void build(int argc, char *argv[]) {
 		CHECK_FLAG(build_flags, release);
 		CHECK_FLAG(build_flags, run);
 		CHECK_FLAG(build_flags, debug);
+		CHECK_FLAG(build_flags, bench);
 	}
 
 	ADD_FILES("main.c");
@@ -74,6 +82,13 @@ void build(int argc, char *argv[]) {
 
 	if (build_flags.debug) ADD_FLAGS(DEBUG_SYMBOLS);
 
+	// the front end benchmarks, measured with optimizations on
+	if (build_flags.bench && !build_flags.deplicate) {
+		ADD_FILES("dooble/bench.c");
+		ADD_FLAGS("-O2", "-DBENCH");
+	}
+
 	if      (build_flags.unit_test) RUN("unit_test");
+	else if (build_flags.bench)     RUN("bench");
 	else if (build_flags.run)       RUN("");
 }
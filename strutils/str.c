@@ -13,6 +13,14 @@
 #undef realloc
 #undef free
 #undef init_str
+#undef init_strn
+
+// growing a string has to move its entry in the allocation table along with it
+#ifdef MEM_TEST
+#define grow_str(ptr, size) wrap_realloc(ptr, size, __FILE__, __LINE__)
+#else
+#define grow_str(ptr, size) realloc(ptr, size)
+#endif
 
 #ifdef MEM_TEST
 string_t init_str(const char *str, const char *fn, size_t line) {
@@ -33,6 +41,24 @@ string_t init_str(const char *str) {
 	return string;
 }
 
+#ifdef MEM_TEST
+string_t init_strn(const char *str, uint32_t len, const char *fn, size_t line) {
+#else
+string_t init_strn(const char *str, uint32_t len) {
+#endif
+	// exact, most of these are names the AST keeps and never appends to
+	string_t string = { .size = len, .capacity = len + 1 };
+#ifdef MEM_TEST
+	string.str = wrap_malloc(sizeof(char) * string.capacity, (char *) fn, line);
+#else
+	string.str = malloc(sizeof(char) * string.capacity);
+#endif
+
+	memcpy(string.str, str, len);
+	string.str[len] = '\0';
+	return string;
+}
+
 string_t copy_str(const string_t *str) {
 	string_t string = {
 		.size		= str->size,
@@ -50,7 +76,7 @@ do {													\
 	if (sizea + sizeb + 1 > cap) {						\
 		cap = cap * 2 > sizea + sizeb ?					\
 			cap * 2 : cap + sizea + sizeb;				\
-		str = realloc(str, sizeof(char) * cap);			\
+		str = grow_str(str, sizeof(char) * cap);		\
 		if (str == NULL)								\
 			return false;								\
 	}													\
@@ -105,7 +131,7 @@ bool addchar(string_t *str, char ch) {
 	if (str->size + 2 > str->capacity) {
 		str->capacity *= 2;
 
-		str->str = realloc(str->str, sizeof(char) * str->capacity);
+		str->str = grow_str(str->str, sizeof(char) * str->capacity);
 		if (str->str == NULL)
 			return false;
 	}
@@ -17,9 +17,12 @@ typedef struct string {
 
 #ifdef MEM_TEST
 string_t init_str(const char *str, const char *fn, size_t line);
-#define init_str(str) init_str(str, __FILE__, __LINE__)
+string_t init_strn(const char *str, uint32_t len, const char *fn, size_t line);
+#define init_str(str)       init_str(str, __FILE__, __LINE__)
+#define init_strn(str, len) init_strn(str, len, __FILE__, __LINE__)
 #else
 string_t init_str(const char *str);
+string_t init_strn(const char *str, uint32_t len); // str does not need a null terminator
 #endif
 string_t copy_str(const string_t *str);
 bool     concat(string_t *stra, string_t *strb);
@@ -130,6 +130,7 @@ void runTests() {
 #ifdef MEM_TEST
 #define MHTABLE_SIZE 1024
 unsigned int allocated          = 0;
+AllocStats   alloc_stats        = {};
 static bool mallocHashTableOpen = FALSE;
 static MallocHashItem mallocHashTable[MHTABLE_SIZE];
 
@@ -138,6 +139,17 @@ void initMemoryTests() {
 	mallocHashTableOpen = TRUE;
 }
 
+void reset_alloc_stats() {
+	alloc_stats.calls = 0;
+	alloc_stats.peak  = alloc_stats.bytes;
+}
+
+static void count_bytes(size_t added, size_t removed) {
+	alloc_stats.bytes += added;
+	alloc_stats.bytes -= removed;
+	if (alloc_stats.bytes > alloc_stats.peak) alloc_stats.peak = alloc_stats.bytes;
+}
+
 void logMemoryLeak() {
 	printf("%d pointers still allocated\n", allocated);
 	for (int i = 0; i < MHTABLE_SIZE; i++) {
@@ -173,12 +185,14 @@ void mHashTableAdd(void *ptr, size_t size, char *file, unsigned int line) {
 
 	if (mallocHashTable[index].ptr == NULL) {
 		mallocHashTable[index] = hashItem;
+		count_bytes(size, 0);
 		allocated++;
 	} else {
 		MallocHashItem *item = &mallocHashTable[index];
 
 		while(item->next != NULL) {
 			if(item->ptr == ptr) {
+				count_bytes(size, item->size);
 				item->ptr	= ptr;
 				item->size	= size;
 				item->file	= file;
@@ -192,6 +206,7 @@ void mHashTableAdd(void *ptr, size_t size, char *file, unsigned int line) {
 		MallocHashItem *newItem = malloc(sizeof(MallocHashItem));
 		*newItem = hashItem;
 		item->next = newItem;
+		count_bytes(size, 0);
 		allocated++;
 	}
 }
@@ -228,6 +243,7 @@ void mHashTableRemove(void *ptr) {
 	if (item->ptr == NULL) {
 		return;
 	} else if (item->ptr == ptr) {
+		count_bytes(0, item->size);
 		if (item->next == NULL) {
 			item->ptr	= NULL;
 			item->size	= 0;
@@ -247,6 +263,7 @@ void mHashTableRemove(void *ptr) {
 	while (item->next != NULL) {
 		if (item->next->ptr == ptr) {
 			MallocHashItem *toRemove = item->next;
+			count_bytes(0, toRemove->size);
 			item->next = item->next->next;
 			free(toRemove);
 			allocated--;
@@ -257,19 +274,28 @@ void mHashTableRemove(void *ptr) {
 }
 
 void *wrap_malloc(size_t size, char *file, unsigned int line) {
+	alloc_stats.calls++;
 	void *ptr = malloc(size);
 	mHashTableAdd(ptr, size, file, line);
 	return ptr;
 }
 
 void *wrap_calloc(size_t nitems, size_t size, char *file, unsigned int line) {
+	alloc_stats.calls++;
 	void *ptr = calloc(nitems, size);
 	mHashTableAdd(ptr, nitems * size, file, line);
 	return ptr;
 }
 
 void *wrap_realloc(void *ptr, size_t size, char *file, unsigned int line) {
+	alloc_stats.calls++;
+
+	// the block may move, its old entry would look like a leak. A failed
+	// realloc leaves the old block as it was, and still tracked
 	void *tmp = realloc(ptr, size);
+	if (tmp == NULL && size > 0) return NULL;
+
+	mHashTableRemove(ptr);
 	mHashTableAdd(tmp, size, file, line);
 	return tmp;
 }
@@ -82,6 +82,16 @@ extern unsigned int allocated;
 void initMemoryTests(void);
 void logMemoryLeak(void);
 
+// running totals kept by the wrappers below, for benchmarks
+typedef struct {
+	size_t calls; // malloc, calloc and realloc calls
+	size_t bytes; // bytes allocated right now
+	size_t peak;  // the most bytes that were allocated at once
+} AllocStats;
+
+extern AllocStats alloc_stats;
+void reset_alloc_stats(void); // zeroes calls, peak starts over from bytes
+
 typedef struct MallocHashItem_t MallocHashItem;
 struct MallocHashItem_t {
 	void           *ptr;  // ref
@@ -1,8 +1,15 @@
 #include "../testing/testing.h"
+#include "../utils/arena.h"
 #include "../utils/hash.h"
+#include "../utils/decimal.h"
+#include "../utils/file.h"
+#include "../utils/intern.h"
+#include "../utils/lines.h"
 #include "../codegen/codegen.h"
+#include <stdalign.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // code generation tests
 static UnitTest_t code_gen(void) {
@@ -65,10 +72,129 @@ static UnitTest_t hash_map(void) {
 	END_UNIT_TEST();
 }
 
+static UnitTest_t intern_symbols(void) {
+	Symbol a = intern_cstr("hello");
+	Symbol b = intern("hello world", 5);
+	Symbol c = intern_cstr("world");
+
+	ASSERT(a != NO_SYMBOL, "interned symbol is empty");
+	ASSERT(a == b, "equal strings do not share a symbol");
+	ASSERT(a != c, "different strings share a symbol");
+	ASSERT(symbol_len(c) == 5, "symbol length does not match string");
+	ASSERT_STR(symbol_str(b), "hello", "symbol does not hold the interned string");
+
+	// force the table to grow, old symbols must not move
+	char name[16];
+	for_range (i, 1000) {
+		snprintf(name, sizeof(name), "sym%d", i);
+		intern_cstr(name);
+	}
+
+	ASSERT(intern_cstr("hello") == a, "symbol changed after growing the table");
+	ASSERT_STR(symbol_str(c), "world", "symbol text moved after growing the table");
+
+	END_UNIT_TEST();
+}
+
+// newlines on both sides of the 16 byte vector steps and in the scalar tail
+static UnitTest_t line_table(void) {
+	const char source[] = "first line\nsecond line is long\n\nfourth\nlast";
+
+	LineTable lines = init_line_table(source, sizeof(source) - 1);
+
+	ASSERT(lines.len == 5, "wrong number of lines");
+	ASSERT(line_of(&lines, 0) == 0, "start of file is not line 0");
+	ASSERT(line_of(&lines, 10) == 0, "newline belongs to the line it ends");
+	ASSERT(line_of(&lines, 11) == 1, "line after newline is wrong");
+	ASSERT(column_of(&lines, 18) == 7, "column is wrong");
+	ASSERT(line_of(&lines, 31) == 2, "empty line is wrong");
+	ASSERT(line_of(&lines, 39) == 4, "last line without newline is wrong");
+	ASSERT(column_of(&lines, sizeof(source) - 1) == 4, "end of file column is wrong");
+
+	free_line_table(&lines);
+	END_UNIT_TEST();
+}
+
+// whenever the fast path answers, it has to agree with strtod
+static UnitTest_t decimal_rounding(void) {
+	char     text[48];
+	uint64_t seed = 0x9E3779B97F4A7C15;
+
+	for_range (i, 20000) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		const uint64_t mantissa = seed >> (i % 40);
+		const int32_t  exp10    = (int32_t) (seed % 600) - 320;
+
+		double fast;
+		if (!decimal_to_double(mantissa, exp10, &fast)) continue;
+
+		snprintf(text, sizeof(text), "%llue%d", (unsigned long long) mantissa, exp10);
+		ASSERT(fast == strtod(text, NULL), "decimal was not correctly rounded");
+	}
+
+	double value;
+	ASSERT(decimal_to_double(1, 0, &value) && value == 1.0, "1 did not convert");
+	ASSERT(decimal_to_double(0, 400, &value) && value == 0.0, "0 did not convert");
+	ASSERT(!decimal_to_double(1, 400, &value), "overflow was not rejected");
+
+	END_UNIT_TEST();
+}
+
+static UnitTest_t arena_chunks(void) {
+	Arena arena = init_arena(64);
+
+	u64 *first = arena_new(&arena, u64);
+	*first = 42;
+
+	// forces a few more chunks, nothing allocated before may move
+	for_range (i, 100) {
+		u64 *arr = arena_make(&arena, u64, 100);
+		ASSERT(((uintptr_t) arr & (alignof(max_align_t) - 1)) == 0, "allocation is not aligned");
+		ASSERT(arr[99] == 0, "allocation is not zeroed");
+		arr[99] = i;
+	}
+
+	ASSERT(*first == 42, "allocation moved");
+
+	free_arena(&arena);
+	ASSERT(arena.chunks == NULL, "arena was not released");
+	END_UNIT_TEST();
+}
+
+static UnitTest_t file_round_trip(void) {
+	const char *filename = "file_round_trip.tmp";
+
+	smart_string source = init_str("main :: () {\r\n\treturn 0\r\n}\n");
+	ASSERT(write_file(&source, filename), "could not write file");
+
+	FileView view = map_file(filename);
+	ASSERT(view.data != NULL, "could not map file");
+	ASSERT(view.len == source.size, "mapped length does not match");
+	ASSERT(memcmp(view.data, source.str, view.len) == 0, "mapped data does not match");
+	unmap_file(&view);
+
+	smart_string copy = read_file(filename);
+	ASSERT(copy.size == source.size, "read length does not match");
+	ASSERT_STR(copy.str, source.str, "read data does not match");
+
+	freestr(&copy);
+	freestr(&source);
+	remove(filename);
+	END_UNIT_TEST();
+}
+
 #ifdef UNIT_TEST
 MAKE_TEST general_unit_tests(void) {
 	setupUnitTests();
 	ADD_TEST(code_gen);
 	ADD_TEST(hash_map);
+	ADD_TEST(intern_symbols);
+	ADD_TEST(line_table);
+	ADD_TEST(decimal_rounding);
+	ADD_TEST(arena_chunks);
+	ADD_TEST(file_round_trip);
 }
 #endif
@@ -1,6 +1,7 @@
 #include "arena.h"
 #include "err.h"
 #include "utils.h"
+#include <stdalign.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -78,3 +79,66 @@ void pdump(Pool *pool) {
 	free(pool->pool);
 	pool->pool = NULL;
 }
+
+// ===================
+// === CHUNK ARENA ===
+// ===================
+
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_ALIGN     alignof(max_align_t)
+
+struct ArenaChunk_t {
+	ArenaChunk *prev;
+	size_t      used;
+	size_t      cap;
+	alignas(max_align_t) char data[];
+};
+
+static size_t align_size(size_t size) {
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+Arena init_arena(size_t size) {
+	return (Arena) {
+		.chunks = NULL,
+		.next   = size > ARENA_MIN_CHUNK ? size : ARENA_MIN_CHUNK,
+	};
+}
+
+static ArenaChunk *add_chunk(Arena *arena, size_t size) {
+	const size_t cap = size > arena->next ? size : arena->next;
+
+	ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + cap);
+	if (chunk == NULL) PANIC("could not allocate arena chunk");
+
+	chunk->prev   = arena->chunks;
+	chunk->used   = 0;
+	chunk->cap    = cap;
+	arena->chunks = chunk;
+	arena->next   = cap * 2;
+
+	return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+	size = align_size(size);
+
+	ArenaChunk *chunk = arena->chunks;
+	if (chunk == NULL || chunk->used + size > chunk->cap) {
+		chunk = add_chunk(arena, size);
+	}
+
+	void *ptr = &chunk->data[chunk->used];
+	chunk->used += size;
+
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void free_arena(Arena *arena) {
+	while (arena->chunks != NULL) {
+		ArenaChunk *prev = arena->chunks->prev;
+		free(arena->chunks);
+		arena->chunks = prev;
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "utils.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct PoolFree_t {
 	struct PoolFree_t *next;
@@ -18,3 +20,25 @@ bool  init_pool(Pool *p, size_t size, size_t count, bool resize);
 void *palloc   (Pool *pool);
 void  pfree    (Pool *pool, void *ptr);
 void  pdump    (Pool *pool);
+
+/* Chunked bump allocator.
+ *
+ * Memory is handed out from chunks that are never reallocated, so pointers into
+ * an arena stay valid until the whole arena is released with free_arena. Every
+ * new chunk is twice the size of the last one (or as big as the allocation that
+ * didn't fit), so a good first guess keeps everything in a single chunk.
+ *
+ * Nothing is freed on its own, an arena is meant for data that all dies at once. */
+typedef struct ArenaChunk_t ArenaChunk;
+
+typedef struct {
+	ArenaChunk *chunks; // newest first
+	size_t      next;   // capacity of the next chunk
+} Arena;
+
+Arena init_arena(size_t size /* first chunk, in bytes */);
+void *arena_alloc(Arena *arena, size_t size); // aligned for any type, zeroed
+void  free_arena(Arena *arena);
+
+#define arena_new(arena, T)     (T *) arena_alloc(arena, sizeof(T))
+#define arena_make(arena, T, N) (T *) arena_alloc(arena, sizeof(T) * (N))
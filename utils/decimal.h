@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Correctly rounded decimal to double conversion (Eisel-Lemire).
+ *
+ * Finds the double nearest to mantissa * 10^exp10 with a single 128 bit
+ * multiply in the common case. Returns false for the few inputs it cannot
+ * round with certainty (exact halfway cases, subnormals, out of range), those
+ * need a slow path such as strtod. */
+bool decimal_to_double(uint64_t mantissa, int32_t exp10, double *out);
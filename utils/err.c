@@ -7,6 +7,7 @@
 
 static HANDLE h;
 static WORD oldAttrs;
+static bool muted;
 
 void init_error(void) {
 	h = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -20,11 +21,17 @@ void init_error(void) {
 	_error(ERR,  "	Error: ON\n");
 }
 
+void mute_errors(bool mute) {
+	muted = mute;
+}
+
 void _error_file(ErrorLevel el,
 				 const char	*errstr,
 				 int 		line,
 				 const char	*source, ...)
 {
+	if (muted) return;
+
 	SetConsoleTextAttribute(h, FOREGROUND_GREEN);
 	const char *linestr = source;
 	int lineCount = 0;
@@ -53,7 +60,43 @@ void _error_file(ErrorLevel el,
 	SetConsoleTextAttribute(h, oldAttrs);
 }
 
+void _error_at(ErrorLevel el,
+			   const char      *errstr,
+			   const LineTable *lines,
+			   uint32_t         offset, ...)
+{
+	if (muted) return;
+
+	SetConsoleTextAttribute(h, FOREGROUND_GREEN);
+	const uint32_t line    = line_of(lines, offset);
+	const uint32_t column  = offset - lines->starts[line];
+	const char    *linestr = &lines->source[lines->starts[line]];
+
+	printf("%04u\t", line);
+	for (uint32_t i = lines->starts[line]; i < lines->size && lines->source[i] != '\n'; i++) {
+		putchar(lines->source[i]);
+	}
+
+	// keep tabs so the caret lines up with the source above it
+	printf("\n\t");
+	for (uint32_t i = 0; i < column; i++) {
+		putchar(linestr[i] == '\t' ? '\t' : ' ');
+	}
+	putchar('^');
+
+	SetConsoleTextAttribute(h, el);
+	printf("\n\t");
+	va_list args;
+	va_start(args, offset);
+	vprintf(errstr, args);
+	va_end(args);
+	putchar('\n');
+	SetConsoleTextAttribute(h, oldAttrs);
+}
+
 void _error(ErrorLevel el, const char *errstr, ...) {
+	if (muted) return;
+
 	SetConsoleTextAttribute(h, el);
 	va_list args;
 	va_start(args, errstr);
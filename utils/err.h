@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../strutils/str.h"
+#include "lines.h"
 
 typedef enum {
 	LOG  = 0b111, // white
@@ -10,7 +11,12 @@ typedef enum {
 
 void init_error(void);
 
+// drops every message until unmuted, for work that is redone when it fails
+void mute_errors(bool mute);
+
+// rescans source to find the line, only meant for files without a LineTable
 void _error_file(ErrorLevel el, const char *errstr, int line, const char *source, ...);
+void _error_at(ErrorLevel el, const char *errstr, const LineTable *lines, uint32_t offset, ...);
 void _error(ErrorLevel el, const char *errstr, ...);
 
 #define logvar(var) _error(LOG,                 \
@@ -32,3 +38,8 @@ void _error(ErrorLevel el, const char *errstr, ...);
 	_error_file(WARN, errstr, line, source, __VA_ARGS__)
 #define error_file(errstr, line, source, ...) \
 	_error_file(ERR, errstr, line, source, __VA_ARGS__)
+
+#define warn_at(errstr, lines, offset, ...) \
+	_error_at(WARN, errstr, lines, offset __VA_OPT__(,) __VA_ARGS__)
+#define error_at(errstr, lines, offset, ...) \
+	_error_at(ERR, errstr, lines, offset __VA_OPT__(,) __VA_ARGS__)
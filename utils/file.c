@@ -2,40 +2,197 @@
 #include "../strutils/str.h"
 #include "../testing/testing.h"
 #include "err.h"
-#include <corecrt.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-string_t read_file(const char *filename) {
-	string_t filestr = init_str("");
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// what empty files point at, they have nothing to map
+static const char EMPTY_FILE[1] = "";
+
+// one allocation of exactly the file size, filled by a single read
+static char *read_whole(FILE *file, uint32_t *len) {
+	if (fseek(file, 0, SEEK_END) != 0) return NULL;
+
+	const long size = ftell(file);
+	if (size < 0 || size > UINT32_MAX - 1) return NULL;
+
+	rewind(file);
+
+	char *data = malloc(size + 1);
+	if (data == NULL) return NULL;
+
+	if (fread(data, 1, size, file) != (size_t) size) {
+		free(data);
+		return NULL;
+	}
+
+	data[size] = '\0';
+	*len       = size;
+	return data;
+}
+
+#ifdef _WIN32
+FileView map_file(const char *filename) {
+	FileView view = {0};
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		error("Cannot open file: %s", filename);
+		return view;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart > UINT32_MAX) {
+		error("Cannot map file: %s", filename);
+		CloseHandle(file);
+		return view;
+	}
+
+	// a mapping can't be empty
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		view.data = EMPTY_FILE;
+		return view;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (mapping == NULL) {
+		error("Cannot map file: %s", filename);
+		return view;
+	}
+
+	view.data   = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	view.len    = size.QuadPart;
+	view.mapped = view.data != NULL;
+	CloseHandle(mapping); // the view keeps the mapping alive
+
+	if (view.data == NULL) error("Cannot map file: %s", filename);
+	return view;
+}
+
+void unmap_file(FileView *view) {
+	if (view->mapped) UnmapViewOfFile(view->data);
 
-	FILE *file;
-	if (fopen_s(&file, filename, "r") != 0) {
-		error("Cannot open file: ");
-		error(filename);
-		return filestr;
+	*view = (FileView) {0};
+}
+#else
+FileView map_file(const char *filename) {
+	FileView view = {0};
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		error("Cannot open file: %s", filename);
+		return view;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size > UINT32_MAX) {
+		error("Cannot map file: %s", filename);
+		close(fd);
+		return view;
+	}
+
+	// a mapping can't be empty
+	if (st.st_size == 0) {
+		close(fd);
+		view.data = EMPTY_FILE;
+		return view;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+		close(fd); // the mapping keeps the file alive
+		view.data   = data;
+		view.len    = st.st_size;
+		view.mapped = true;
+		return view;
+	}
+
+	// not everything can be mapped, fall back to reading the whole file. A read
+	// may return less than asked for, a file that shrank ends early
+	char   *buffer = malloc(st.st_size + 1);
+	ssize_t got    = 0;
+	while (buffer != NULL && got < st.st_size) {
+		const ssize_t n = read(fd, buffer + got, st.st_size - got);
+		if (n == 0) break;
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) {
+			got = -1;
+			break;
+		}
+
+		got += n;
+	}
+
+	if (buffer != NULL && got >= 0) {
+		buffer[got] = '\0';
+		view.data = buffer;
+		view.len  = got;
+	} else {
+		free(buffer);
+		error("Cannot read file: %s", filename);
+	}
+
+	close(fd);
+	return view;
+}
+
+void unmap_file(FileView *view) {
+	if (view->mapped) {
+		munmap((void *) view->data, view->len);
+	} else if (view->data != EMPTY_FILE) {
+		free((void *) view->data);
 	}
 
-	char ch;
-	while ((ch = fgetc(file)) != EOF) {
-		addchar(&filestr, ch);
+	*view = (FileView) {0};
+}
+#endif
+
+string_t read_file(const char *filename) {
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) {
+		error("Cannot open file: %s", filename);
+		return init_str("");
 	}
 
+	uint32_t len  = 0;
+	char    *data = read_whole(file, &len);
 	fclose(file);
-	return filestr;
+
+	if (data == NULL) {
+		error("Cannot read file: %s", filename);
+		return init_str("");
+	}
+
+	return (string_t) {
+		.str      = data,
+		.size     = len,
+		.capacity = len + 1,
+	};
 }
 
 bool write_file(string_t *str, const char *filename) {
-	FILE *file;
-	if (fopen_s(&file, filename, "w") != 0) {
-		error("Cannot open file: ");
-		error(filename);
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) {
+		error("Cannot open file: %s", filename);
 		return false;
 	}
 
-	for (int i = 0; i < str->size; i++) {
-		fputc(str->str[i], file);
-	}
+	const bool written = fwrite(str->str, 1, str->size, file) == str->size;
+	if (!written) error("Cannot write file: %s", filename);
 
 	fclose(file);
-	return true;
+	return written;
 }
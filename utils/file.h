@@ -9,5 +9,17 @@ struct FileTree_t {
 	char		**files;
 };
 
+// A read only, length delimited view of a whole file. It is mapped straight
+// from the file when possible, otherwise read into an exactly sized buffer.
+// data is not null terminated.
+typedef struct {
+	const char *data; // NULL if the file could not be opened
+	uint32_t    len;
+	bool        mapped;
+} FileView;
+
+FileView map_file(const char *filename);
+void     unmap_file(FileView *view);
+
 string_t read_file(const char *filename);
 bool write_file(string_t *str, const char *filename);
@@ -0,0 +1,165 @@
+#include "intern.h"
+#include "hash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// strings are packed into blocks that never get reallocated. Anything larger than
+// a block gets a block to itself.
+#define SYMBOL_BLOCK_SIZE 4096
+#define SYMBOL_INIT_SIZE  256 // must be a power of 2
+
+typedef struct SymbolBlock_t SymbolBlock;
+struct SymbolBlock_t {
+	SymbolBlock *prev;
+	u32          used;
+	u32          cap;
+	char         data[];
+};
+
+typedef struct {
+	const char *str; // ref into a block
+	u32         len;
+	u32         hash;
+} SymbolEntry;
+
+static struct {
+	SymbolBlock *blocks;
+
+	VEC(SymbolEntry) entries; // indexed by Symbol
+
+	// open addressing table of symbols, 0 is empty
+	Symbol *table;
+	u32     table_cap;
+} interner;
+
+// FNV-1a
+static u32 hash_bytes(const char *str, u32 len) {
+	u32 hash = 2166136261u;
+	for_range (i, len) {
+		hash ^= (u8) str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void init_interner(void) {
+	interner.entries.arr = make(SymbolEntry, SYMBOL_INIT_SIZE);
+	interner.entries.cap = SYMBOL_INIT_SIZE;
+	interner.entries.len = 1; // reserve NO_SYMBOL
+
+	interner.table     = make(Symbol, SYMBOL_INIT_SIZE * 2);
+	interner.table_cap = SYMBOL_INIT_SIZE * 2;
+}
+
+static const char *store_str(const char *str, u32 len) {
+	SymbolBlock *block = interner.blocks;
+
+	if (block == NULL || block->used + len + 1 > block->cap) {
+		u32 cap = len + 1 > SYMBOL_BLOCK_SIZE ? len + 1 : SYMBOL_BLOCK_SIZE;
+
+		block = malloc(sizeof(SymbolBlock) + cap);
+		if (block == NULL) PANIC("could not allocate symbol block");
+
+		block->prev     = interner.blocks;
+		block->used     = 0;
+		block->cap      = cap;
+		interner.blocks = block;
+	}
+
+	char *dst = &block->data[block->used];
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+
+	block->used += len + 1;
+	return dst;
+}
+
+static void grow_table(void) {
+	const u32 new_cap = interner.table_cap * 2;
+	Symbol   *table   = make(Symbol, new_cap);
+
+	for (Symbol sym = 1; sym < interner.entries.len; sym++) {
+		u32 slot = interner.entries.arr[sym].hash & (new_cap - 1);
+		while (table[slot] != NO_SYMBOL) slot = (slot + 1) & (new_cap - 1);
+
+		table[slot] = sym;
+	}
+
+	free(interner.table);
+	interner.table     = table;
+	interner.table_cap = new_cap;
+}
+
+Symbol intern(const char *str, u32 len) {
+	if (interner.table == NULL) init_interner();
+
+	const u32 hash = hash_bytes(str, len);
+	u32       slot = hash & (interner.table_cap - 1);
+
+	while (interner.table[slot] != NO_SYMBOL) {
+		const SymbolEntry *entry = &interner.entries.arr[interner.table[slot]];
+
+		if (entry->hash == hash
+				&& entry->len == len
+				&& memcmp(entry->str, str, len) == 0)
+		{
+			return interner.table[slot];
+		}
+
+		slot = (slot + 1) & (interner.table_cap - 1);
+	}
+
+	if (interner.entries.len >= interner.entries.cap) {
+		interner.entries.cap *= 2;
+		void *tmp = realloc(interner.entries.arr, sizeof(SymbolEntry) * interner.entries.cap);
+		if (tmp == NULL) PANIC("could not extend symbol entries");
+
+		interner.entries.arr = tmp;
+	}
+
+	const Symbol sym = interner.entries.len++;
+	interner.entries.arr[sym] = (SymbolEntry) {
+		.str  = store_str(str, len),
+		.len  = len,
+		.hash = hash,
+	};
+	interner.table[slot] = sym;
+
+	float load = (float) interner.entries.len / (float) interner.table_cap;
+	if (load > HASH_MAX_LOAD) grow_table();
+
+	return sym;
+}
+
+Symbol intern_cstr(const char *str) {
+	return intern(str, strlen(str));
+}
+
+const char *symbol_str(Symbol sym) {
+	DYNAMIC_ASSERT(sym != NO_SYMBOL && sym < interner.entries.len, "invalid symbol");
+	return interner.entries.arr[sym].str;
+}
+
+u32 symbol_len(Symbol sym) {
+	DYNAMIC_ASSERT(sym != NO_SYMBOL && sym < interner.entries.len, "invalid symbol");
+	return interner.entries.arr[sym].len;
+}
+
+void free_symbols(void) {
+	while (interner.blocks != NULL) {
+		SymbolBlock *prev = interner.blocks->prev;
+		free(interner.blocks);
+		interner.blocks = prev;
+	}
+
+	free(interner.entries.arr);
+	free(interner.table);
+
+	interner.entries.arr = NULL;
+	interner.entries.len = 0;
+	interner.entries.cap = 0;
+	interner.table       = NULL;
+	interner.table_cap   = 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "utils.h"
+
+/* Compiler wide string interning.
+ *
+ * Every distinct string gets exactly one Symbol, so symbols can be compared and
+ * hashed as plain integers instead of re-hashing and strcmp-ing the text on every
+ * lookup. Symbol 0 is never handed out, which lets hash tables keep using 0 as
+ * their empty marker.
+ *
+ * The text of a symbol never moves once it is interned, so the pointer returned
+ * by symbol_str is valid until free_symbols is called. */
+typedef u32 Symbol;
+#define NO_SYMBOL 0
+
+Symbol      intern(const char *str, u32 len); // str does not need a null terminator
+Symbol      intern_cstr(const char *str);
+const char *symbol_str(Symbol sym);
+u32         symbol_len(Symbol sym);
+void        free_symbols(void);
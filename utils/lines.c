@@ -0,0 +1,91 @@
+#include "lines.h"
+#include "utils.h"
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	define LINES_SSE2
+#	include <emmintrin.h>
+#endif
+
+// bit i is set when source[pos + i] is a newline
+#ifdef LINES_SSE2
+static inline u32 newline_mask(const char *source, u32 pos) {
+	__m128i v = _mm_loadu_si128((const __m128i *) &source[pos]);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+#endif
+
+static u32 count_newlines(const char *source, u32 size) {
+	u32 count = 0;
+	u32 pos   = 0;
+
+#ifdef LINES_SSE2
+	for (; pos + 16 <= size; pos += 16) {
+		count += __builtin_popcount(newline_mask(source, pos));
+	}
+#endif
+
+	for (; pos < size; pos++) {
+		count += source[pos] == '\n';
+	}
+
+	return count;
+}
+
+LineTable init_line_table(const char *source, u32 size) {
+	// sized exactly up front, so filling it in never has to check
+	const u32 len = count_newlines(source, size) + 1;
+
+	LineTable lines = {
+		.source = source,
+		.starts = malloc(sizeof(u32) * len),
+		.len    = len,
+		.size   = size,
+	};
+
+	if (lines.starts == NULL) PANIC("could not allocate line table");
+
+	lines.starts[0] = 0;
+
+	u32 line = 1;
+	u32 pos  = 0;
+
+#ifdef LINES_SSE2
+	for (; pos + 16 <= size; pos += 16) {
+		for (u32 mask = newline_mask(source, pos); mask != 0; mask &= mask - 1) {
+			lines.starts[line++] = pos + __builtin_ctz(mask) + 1;
+		}
+	}
+#endif
+
+	for (; pos < size; pos++) {
+		if (source[pos] == '\n') lines.starts[line++] = pos + 1;
+	}
+
+	return lines;
+}
+
+// the last line starting at or before offset
+u32 line_of(const LineTable *lines, u32 offset) {
+	u32 lo = 0;
+	u32 hi = lines->len;
+
+	while (hi - lo > 1) {
+		const u32 mid = lo + (hi - lo) / 2;
+
+		if (lines->starts[mid] <= offset) lo = mid;
+		else                              hi = mid;
+	}
+
+	return lo;
+}
+
+u32 column_of(const LineTable *lines, u32 offset) {
+	return offset - lines->starts[line_of(lines, offset)];
+}
+
+void free_line_table(LineTable *lines) {
+	free(lines->starts);
+	lines->starts = NULL;
+	lines->len    = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Where every line of a source buffer starts.
+ *
+ * Built once per file, so tokens only need to remember a byte offset and the
+ * line and column of a diagnostic are found with a binary search instead of
+ * rescanning the file from the top. Lines and columns are 0 based. */
+typedef struct {
+	const char *source;
+	uint32_t   *starts; // byte offset of each line, starts[0] is always 0
+	uint32_t    len;    // number of lines
+	uint32_t    size;   // bytes in source
+} LineTable;
+
+LineTable init_line_table(const char *source, uint32_t size);
+uint32_t  line_of(const LineTable *lines, uint32_t offset);
+uint32_t  column_of(const LineTable *lines, uint32_t offset);
+void      free_line_table(LineTable *lines);
@@ -28,7 +28,7 @@
 #define PAIR(A, B) struct { A a; B b; }
 #define EXTEND_ARR(type, arr, len, cap)                   \
 	do {                                                  \
-		if (len > cap) {                                  \
+		if (len >= cap) {                                 \
 			cap *= 2;                                     \
 			void *tmp = realloc(arr, sizeof(type) * cap); \
 			if (tmp == NULL) {                            \